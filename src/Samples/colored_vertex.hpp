@@ -31,33 +31,15 @@ namespace lightroom
         public:
             ColoredTriangle3D(const std::array<ColoredVertex3D*, 3>& _vs) : Triangle3D<ColoredVertex3D>(_vs) {}
         protected:
-            virtual void putPixel(
-                int _x, int _y, Float _alpha, Float _beta, Float _gamma,
-                WritableColorMap* _colorMap, DepthBuffer& _depthBuffer) const override
+            virtual Color shade(int _x, int _y, Float _alpha, Float _beta, Float _gamma) const override
             {
-                int _index = _y * _colorMap->getWidth() + _x;
-
-                Float _depth = linearInterpolation<Float>(
-                    _alpha, _beta, _gamma,
-                    [](const ColoredVertex3D* _v)
-                    {
-                        return _v->position[2];
-                    });
-                if (_depth <= _depthBuffer[_index])
-                {
-                    return;
-                }
-
-                auto _color = perspectiveInterpolation<Color>(
+                return linearInterpolation<Color>(
                     _alpha, _beta, _gamma,
                     [](const ColoredVertex3D* _v)
                     {
                         auto _tv = static_cast<const ColoredVertex3D*>(_v);
                         return _tv->color;
                     });
-
-                _depthBuffer[_index] = _depth;
-                _colorMap->set(_index, _color);
             }
         };
 
@@ -146,7 +128,6 @@ namespace lightroom
                     std::cout << "FPS: " << (int)(1000 * perfFreq.QuadPart / deltapc) << " (lock: " << lockFPS << ")" << std::endl;
 
                     pm.render();
-                    output->wipe();
                 }
             }
 
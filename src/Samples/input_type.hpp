@@ -67,30 +67,25 @@ namespace lightroom
                 pm.render();
                 getchar();
                 pm.clear();
-                output->wipe();
 
                 pm.input(PrimitiveInputType::LINE_STRIP, vs);
                 pm.render();
                 getchar();
                 pm.clear();
-                output->wipe();
 
                 pm.input(PrimitiveInputType::LINE_LOOP, vs);
                 pm.render();
                 getchar();
                 pm.clear();
-                output->wipe();
 
                 pm.input(PrimitiveInputType::TRIANGLE_STRIP, vs);
                 pm.render();
                 getchar();
                 pm.clear();
-                output->wipe();
 
                 pm.input(PrimitiveInputType::TRIANGLE_FAN, vs);
                 pm.render();
                 getchar();
-                output->wipe();
             }
 
             ~InputType()
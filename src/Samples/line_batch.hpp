@@ -0,0 +1,83 @@
+#pragma once
+#include <iostream>
+#include <random>
+#include "../lightroom.hpp"
+
+namespace lightroom
+{
+    namespace sample
+    {
+        class WireVertex3D : public Vertex3D
+        {
+        public:
+            WireVertex3D(const Vertex3DIn* _vin, PrimitiveInputType primitiveType) :
+                Vertex3D(_vin, primitiveType) {}
+        };
+
+        // Benchmark: a million-segment wireframe through the batch line renderer.
+        // With pinned, the raster workers are pinned node by node and each owns the framebuffer
+        // rows it draws, first-touched on its own node.
+        class LineBatch
+        {
+        private:
+            JobSystem* jobs;
+            SequenceMap* output;
+            std::vector<LineSegment3D> segments;
+        public:
+            LineBatch(size_t segmentCount = 1000000, bool pinned = false)
+            {
+                SetProcessDpiAwareness(PROCESS_SYSTEM_DPI_AWARE);
+                int w = GetSystemMetrics(SM_CXSCREEN);
+                int h = GetSystemMetrics(SM_CYSCREEN);
+                auto& topology = NumaTopology::get();
+                jobs = pinned ? new JobSystem(0, topology.getAffinity()) : nullptr;
+                output = new SequenceMap(PxCoordinate{ w, h }, nullptr, false, jobs);
+
+                auto resident = output->getResidentBytes();
+                for (size_t node = 0; node < topology.getNodeCount(); node++)
+                {
+                    std::cout << "Framebuffer on node " << node << ": " << (resident[node] >> 10) << " KiB" << std::endl;
+                }
+                std::cout << "Framebuffer elsewhere: " << (resident.back() >> 10) << " KiB" << std::endl;
+
+                // short random strokes inside a cube, like a scanned point cloud's neighbour edges
+                std::mt19937 rng(1234);
+                std::uniform_real_distribution<float> pos(-20, 20), step(-0.6f, 0.6f), tone(0.3f, 1);
+                segments.reserve(segmentCount);
+                for (size_t i = 0; i < segmentCount; i++)
+                {
+                    float x = pos(rng), y = pos(rng), z = pos(rng);
+                    auto c = static_cast<uint8_t>(tone(rng) * 255);
+                    segments.push_back({ { x, y, z }, { x + step(rng), y + step(rng), z + step(rng) },
+                                         static_cast<COLORREF>(c | (c << 8) | (0xff << 16)) });
+                }
+
+                auto camara = Camara(Vector<3>{ 173, 0, 100 }, Vector<3>{ -173, 0, -100 }, Vector<3>{ -100, 0, 173 }, 1.36);
+                Pipeline<WireVertex3D, Line3D<WireVertex3D>, Triangle3D<WireVertex3D>> pm(camara, output,
+                    jobs ? *jobs : JobSystem::getDefault());
+
+                size_t frames = 0;
+                double seconds = 0;
+                while (!GetAsyncKeyState('\r'))
+                {
+                    pm.clear();
+                    pm.inputLines(segments);
+                    pm.render();
+                    pm.camara.apply(TransformMixer3D().rotate(0, 0, 0.01));
+
+                    auto& renderer = pm.getLineBatchRenderer();
+                    frames++;
+                    seconds += renderer.getLastSeconds();
+                    std::cout << "Segments/s: " << static_cast<size_t>(renderer.getSegmentsPerSecond())
+                        << " (avg " << static_cast<size_t>(frames * segments.size() / seconds) << ")" << std::endl;
+                }
+            }
+
+            ~LineBatch()
+            {
+                delete output;
+                delete jobs;
+            }
+        };
+    }
+}
@@ -11,22 +11,19 @@ namespace lightroom
         {
         public:
             UVCoordinate uvPosition;
-            ColorMap* texture;
 
-            TextureVertex3DIn(const Vector<3>& position,
-                              const UVCoordinate& uvPosition, ColorMap* texture) :
-                Vertex3DIn(position), uvPosition(uvPosition), texture(texture) {}
+            TextureVertex3DIn(const Vector<3>& position, const UVCoordinate& uvPosition) :
+                Vertex3DIn(position), uvPosition(uvPosition) {}
         };
         class TextureVertex3D : public Vertex3D
         {
         public:
             UVCoordinate uvPosition;
-            ColorMap* texture;
 
             TextureVertex3D(const TextureVertex3DIn* _vin,
                                PrimitiveInputType primitiveType) :
                 Vertex3D(_vin, primitiveType),
-                uvPosition(_vin->uvPosition), texture(_vin->texture) {}
+                uvPosition(_vin->uvPosition) {}
         };
 
         class TextureTriangle3D : public Triangle3D<TextureVertex3D>
@@ -34,42 +31,69 @@ namespace lightroom
         public:
             TextureTriangle3D(const std::array<TextureVertex3D*, 3>& _vs) : Triangle3D(_vs) {}
         protected:
-            virtual void putPixel(
-                int _x, int _y, Float _alpha, Float _beta, Float _gamma,
-                WritableColorMap* _colorMap, DepthBuffer& _depthBuffer) const override
-            {
-                int _index = _y * _colorMap->getWidth() + _x;
+            mutable const TextureMap* _texture = nullptr;
+            mutable const TextureSampler* _sampler = nullptr;
+            mutable Float _lod = 0;
 
-                Float _depth = linearInterpolation<Float>(
-                    _alpha, _beta, _gamma,
-                    [](const TextureVertex3D* _v)
-                    {
-                        return _v->position[2];
-                    });
-                if (_depth <= _depthBuffer[_index])
+            // texture, sampler and one LOD per triangle, from the material and the affine UV derivatives
+            virtual void setup(Float _dbetadx, Float _dbetady, Float _dgammadx, Float _dgammady) const override
+            {
+                _texture = _material->texture;
+                _sampler = &_material->sampler;
+                if (!_texture)
                 {
                     return;
                 }
+                auto& _uv0 = _vertices[0]->uvPosition;
+                UVCoordinate _e1 = _vertices[1]->uvPosition - _uv0;
+                UVCoordinate _e2 = _vertices[2]->uvPosition - _uv0;
+                auto& _scale = _material->uvScale;
+                _lod = _sampler->computeLod(*_texture,
+                                            (_dbetadx * _e1 + _dgammadx * _e2).cwiseProduct(_scale),
+                                            (_dbetady * _e1 + _dgammady * _e2).cwiseProduct(_scale));
+            }
+            virtual Color shade(int _x, int _y, Float _alpha, Float _beta, Float _gamma) const override
+            {
+                if (!_texture)
+                {
+                    return _material->baseColor;
+                }
 
-                auto __u = perspectiveInterpolation<Float>(
+                auto _uv = linearInterpolation<UVCoordinate>(
                     _alpha, _beta, _gamma,
                     [](const TextureVertex3D* _v)
                     {
-                        auto _tv = static_cast<const TextureVertex3D*>(_v);
-                        return _tv->uvPosition[0];
+                        return _v->uvPosition;
                     });
-                auto __v = perspectiveInterpolation<Float>(
-                    _alpha, _beta, _gamma,
-                    [](const TextureVertex3D* _v)
-                    {
-                        auto _tv = static_cast<const TextureVertex3D*>(_v);
-                        return _tv->uvPosition[1];
-                    });
-
-                _depthBuffer[_index] = _depth;
-                _colorMap->set(_index,
-                               static_cast<const TextureVertex3D*>(_vertices[0])->
-                               texture->get(UVCoordinate{ __u, __v }));
+                return _sampler->sample(*_texture, _material->remap(_uv), _lod);
+            }
+            // one gathered sample of eight texels; the triangle shares one LOD anyway
+            virtual void shade8(const int* _x, const int* _y, const Float* _alpha, const Float* _beta,
+                                const Float* _gamma, int _count, Color* _out) const override
+            {
+                if (!_texture)
+                {
+                    std::fill(_out, _out + _count, _material->baseColor);
+                    return;
+                }
+                auto& _uv0 = _vertices[0]->uvPosition;
+                auto& _uv1 = _vertices[1]->uvPosition;
+                auto& _uv2 = _vertices[2]->uvPosition;
+                float _u[8], _v[8];
+                for (int _i = 0; _i < 8; _i++)
+                {
+                    // spare lanes repeat the last pixel
+                    int _p = min(_i, _count - 1);
+                    UVCoordinate _uv = _material->remap(_alpha[_p] * _uv0 + _beta[_p] * _uv1 + _gamma[_p] * _uv2);
+                    _u[_i] = static_cast<float>(_uv[0]);
+                    _v[_i] = static_cast<float>(_uv[1]);
+                }
+                Texel _texels[8];
+                _sampler->sample8(*_texture, _u, _v, _lod, _texels);
+                for (int _i = 0; _i < _count; _i++)
+                {
+                    _out[_i] = unpackTexel(_texels[_i]);
+                }
             }
         };
 
@@ -98,26 +122,41 @@ namespace lightroom
                 ++LockArgs.frameIndex;
                 return ticks;
             }
-            SequenceMap* output;
-            ImageMap* texture;
+            SwapChain* swapChain = nullptr;
+            TextureStreamer streamer;
+            TextureResidencyManager residency{ streamer, size_t(256) << 20 };
+            std::shared_ptr<StreamingTexture> texture;
             std::vector<TextureVertex3DIn*> vs;
         public:
             Textured() :
-                texture(new ImageMap(L".\\test.png", PxCoordinate{ 1000, 1000 })),
+                // the window opens at once and the texture sharpens as its mips stream in
+                texture(residency.request(std::filesystem::exists(L".\\test.lrtex") ? L".\\test.lrtex" : L".\\test.png")),
                 vs({
-                    new TextureVertex3DIn{ Vector<3>( 20, -25, -15), UVCoordinate(0, 1), texture },
-                    new TextureVertex3DIn{ Vector<3>( 20,  25, -15), UVCoordinate(1, 1), texture },
-                    new TextureVertex3DIn{ Vector<3>(-20,  25,  15), UVCoordinate(1, 0), texture },
-                    new TextureVertex3DIn{ Vector<3>(-20, -25,  15), UVCoordinate(0, 0), texture } })
+                    new TextureVertex3DIn{ Vector<3>( 20, -25, -15), UVCoordinate(0, 1) },
+                    new TextureVertex3DIn{ Vector<3>( 20,  25, -15), UVCoordinate(1, 1) },
+                    new TextureVertex3DIn{ Vector<3>(-20,  25,  15), UVCoordinate(1, 0) },
+                    new TextureVertex3DIn{ Vector<3>(-20, -25,  15), UVCoordinate(0, 0) } })
             {
+                // request() returns nullptr when neither file exists or its header is unreadable
+                if (!texture)
+                {
+                    std::cout << "Cannot read .\\test.lrtex or .\\test.png" << std::endl;
+                    return;
+                }
                 SetProcessDpiAwareness(PROCESS_SYSTEM_DPI_AWARE);
                 int w = GetSystemMetrics(SM_CXSCREEN);
                 int h = GetSystemMetrics(SM_CYSCREEN);
-                output = new SequenceMap(PxCoordinate{ w, h });
+                // three colour targets, printed and wiped by the swap chain's present thread; tiled
+                // colour and depth let the rasterizer walk each triangle column by column
+                swapChain = new SwapChain(PxCoordinate{ w, h }, 3, nullptr, true);
 
                 auto camara = Camara(Vector<3>{ 100, 0, 0 }, Vector<3>{ -100, 0, 0 }, Vector<3>{ 0, 0, 1 }, 1.36);
-                Pipeline<TextureVertex3D, Line3D<TextureVertex3D>, TextureTriangle3D> pm(camara, output);
+                // two frames in flight: each frame's vertex work overlaps the previous frame's raster
+                Pipeline<TextureVertex3D, Line3D<TextureVertex3D>, TextureTriangle3D> pm(
+                    camara, *swapChain, JobSystem::getDefault(), 2);
+                MaterialId material = pm.materials.add({ texture.get() });
 
+                std::deque<std::shared_future<void>> frames;    // renderAsync() frames, oldest first
                 LARGE_INTEGER timers[2]{}, perfFreq{ 0 };
                 QueryPerformanceFrequency(&perfFreq);
                 size_t lockFPS = 200;
@@ -125,7 +164,7 @@ namespace lightroom
                 while (true)
                 {
                     pm.clear();
-                    pm.input(PrimitiveInputType::TRIANGLE_FAN, vs);
+                    pm.input(PrimitiveInputType::TRIANGLE_FAN, vs, material);
 
                     if (GetAsyncKeyState('\r'))
                     {
@@ -136,8 +175,16 @@ namespace lightroom
 
                     std::cout << "FPS: " << (int)(1000 * perfFreq.QuadPart / deltapc) << " (lock: " << lockFPS << ")" << std::endl;
 
-                    pm.render();
-                    output->wipe();
+                    // raster runs on the job system; the camera update and the next frame's recording
+                    // go ahead meanwhile
+                    frames.push_back(pm.renderAsync().share());
+                    // a frame's sampling is over once its future is ready; the newest frame still
+                    // running keeps the levels evicted meanwhile alive
+                    while (!frames.empty() && frames.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                    {
+                        frames.pop_front();
+                        residency.endFrame(frames.empty() ? std::shared_future<void>() : frames.back());
+                    }
                     pm.camara.apply(TransformMixer3D().rotate(0, 0, 0.02));
                     //pm.camara.lookAt({ 0, 0, 0 });
                 }
@@ -145,8 +192,7 @@ namespace lightroom
 
             ~Textured()
             {
-                delete output;
-                delete texture;
+                delete swapChain;
 
                 for (auto v : std::set<TextureVertex3DIn*>(vs.begin(), vs.end()))
                 {
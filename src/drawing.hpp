@@ -6,5 +6,7 @@
 #include "drawing/viewport.hpp"
 #include "drawing/vertices.hpp"
 #include "drawing/GraphObj.hpp"
+#include "drawing/line_batch.hpp"
+#include "drawing/swap_chain.hpp"
 
 #endif // !_DRAWING_
@@ -6,9 +6,29 @@ namespace lightroom
     class GraphObj3D
     {
     public:
-        virtual inline void draw(WritableColorMap* _out,
-                                 DepthBuffer& _depthBuffer,
-                                 Float _nplain, Float _fplain) const = 0;
+        MaterialId material = 0;
+
+        // Per-primitive work ahead of rasterization. _material is this primitive's entry in the
+        // pipeline's material table and _state its fixed-function state. Different primitives
+        // may be prepared concurrently.
+        virtual inline void prepare(const WritableColorMap* _out,
+                                    Float _nplain, Float _fplain,
+                                    const Material* _material,
+                                    const PipelineState& _state) const {}
+        // Rasterizes the prepared primitive into pixel rows [_rowMin, _rowMax] only. Bands made of
+        // whole depth tiles share no pixels, so each may be drawn by its own thread.
+        virtual inline void drawRows(WritableColorMap* _out,
+                                     DepthBuffer& _depthBuffer,
+                                     int _rowMin, int _rowMax) const = 0;
+        inline void draw(WritableColorMap* _out,
+                         DepthBuffer& _depthBuffer,
+                         Float _nplain, Float _fplain,
+                         const Material* _material,
+                         const PipelineState& _state) const
+        {
+            prepare(_out, _nplain, _fplain, _material, _state);
+            drawRows(_out, _depthBuffer, 0, _out->getHeight() - 1);
+        }
         virtual inline ~GraphObj3D() = default;
     };
 
@@ -30,10 +50,14 @@ namespace lightroom
             return _vertices[0] != nullptr && _vertices[1] != nullptr;
         }
 
-        virtual inline void draw(
+        // Midpoint walk, started at the first pixel inside [_rowMin, _rowMax] and stopped at the
+        // last one, so a band costs only its own rows. The starting pixel and decision variable
+        // come from the line equation of the endpoints sorted by x, so both vertex orders draw
+        // the same pixels.
+        virtual inline void drawRows(
             WritableColorMap* _outColorMap,
             DepthBuffer& _depthBuffer,
-            Float _nplain, Float _fplain) const override final
+            int _rowMin, int _rowMax) const override final
         {
             auto _v0 = _vertices[0];
             auto _v1 = _vertices[1];
@@ -49,27 +73,37 @@ namespace lightroom
                 _x1_x0 = _x1 - _x0;
             Float k = Float(_y1_y0) / _x1_x0;
 
-            int _xMin = max(0, min(_x0, _x1)),
-                _xMax = min(_outColorMap->getWidth(), max(_x0, _x1)),
-                _yMin = max(0, min(_y0, _y1)),
-                _yMax = min(_outColorMap->getHeight(), max(_y0, _y1));
-
-            int _x = _x0,
-                _y = _y0;
+            int _width = _outColorMap->getWidth(),
+                _height = _outColorMap->getHeight();
+            // _line(x, y) is zero on the line, as _x1_x0 * y - _y1_y0 * x + _c
+            int64_t _c = int64_t(_x0) * _y1 - int64_t(_x1) * _y0;
+            auto _line = [&](Float _x, Float _y)
+            {
+                return _x1_x0 * _y - _y1_y0 * _x + Float(_c);
+            };
+            int64_t _dx2 = 2 * int64_t(_x1_x0), _dy2 = 2 * int64_t(_y1_y0);
 
             Float _t = 0;
             Float _depth = _v0->position[2];
             if (k <= -1)
             {
-                Float _d = _lineFunction(_x + 0.5, _y - 1);
+                int _y = min(_y0, _rowMax),
+                    _yEnd = max(max(0, _y1), _rowMin);
+                if (_y < _yEnd)
+                {
+                    return;
+                }
+                int _x = static_cast<int>(_ceilDiv(-_dx2 * _y - 2 * _c + _y1_y0, -_dy2));
+                Float _d = _line(_x + 0.5, _y - 1);
 
                 Float _dt = sqrt((Float(1) / (k * k) + 1) / (_x1_x0 * _x1_x0 + _y1_y0 * _y1_y0));
                 Float _ddepth = _dt * (_v1->position[2] - _v0->position[2]);
+                _t = (_y0 - _y) * _dt;
+                _depth += (_y0 - _y) * _ddepth;
 
-                for (; _y >= _yMin; _y--)
+                for (; _y >= _yEnd; _y--)
                 {
-                    if (_y >= 0 && _y < _outColorMap->getHeight() &&
-                        _x >= 0 && _x < _outColorMap->getWidth())
+                    if (_y < _height && _x >= 0 && _x < _width)
                     {
                         putPixel(_x, _y, _t, _outColorMap, _depthBuffer);
                     }
@@ -90,14 +124,26 @@ namespace lightroom
             }
             else if (k <= 0)
             {
-                Float _d = _lineFunction(_x + 1, _y - 0.5);
+                int _x = _x0,
+                    _xEnd = min(_width, _x1);
+                if (_y1_y0 == 0 && (_y0 < _rowMin || _y0 > _rowMax))
+                {
+                    return;
+                }
+                if (_y1_y0 != 0)
+                {
+                    _x = max(_x0, static_cast<int>(_floorDiv(-(_dx2 * _rowMax + _x1_x0 + 2 * _c), -_dy2) + 1));
+                }
+                int _y = static_cast<int>(_floorDiv(_dy2 * _x - 2 * _c + _x1_x0, _dx2));
+                Float _d = _line(_x + 1, _y - 0.5);
 
                 Float _dt = sqrt((k * k + 1) / (_x1_x0 * _x1_x0 + _y1_y0 * _y1_y0));
                 Float _ddepth = _dt * (_v1->position[2] - _v0->position[2]);
-                for (; _x <= _xMax; _x++)
+                _t = (_x - _x0) * _dt;
+                _depth += (_x - _x0) * _ddepth;
+                for (; _x <= _xEnd && _y >= _rowMin; _x++)
                 {
-                    if (_y >= 0 && _y < _outColorMap->getHeight() &&
-                        _x >= 0 && _x < _outColorMap->getWidth())
+                    if (_y < _height && _x >= 0 && _x < _width)
                     {
                         putPixel(_x, _y, _t, _outColorMap, _depthBuffer);
                     }
@@ -118,14 +164,18 @@ namespace lightroom
             }
             else if (k <= 1)
             {
-                Float _d = _lineFunction(_x + 1, _y + 0.5);
+                int _x = max(_x0, static_cast<int>(_floorDiv(_dx2 * _rowMin - _x1_x0 + 2 * _c, _dy2) + 1)),
+                    _xEnd = min(_width, _x1);
+                int _y = static_cast<int>(_ceilDiv(_dy2 * _x - 2 * _c - _x1_x0, _dx2));
+                Float _d = _line(_x + 1, _y + 0.5);
 
                 Float _dt = sqrt((k * k + 1) / (_x1_x0 * _x1_x0 + _y1_y0 * _y1_y0));
                 Float _ddepth = _dt * (_v1->position[2] - _v0->position[2]);
-                for (; _x <= _xMax; _x++)
+                _t = (_x - _x0) * _dt;
+                _depth += (_x - _x0) * _ddepth;
+                for (; _x <= _xEnd && _y <= _rowMax; _x++)
                 {
-                    if (_y >= 0 && _y < _outColorMap->getHeight() &&
-                        _x >= 0 && _x < _outColorMap->getWidth())
+                    if (_y < _height && _x >= 0 && _x < _width)
                     {
                         putPixel(_x, _y, _t, _outColorMap, _depthBuffer);
                     }
@@ -145,14 +195,22 @@ namespace lightroom
             }
             else if (k > 1)
             {
-                Float _d = _lineFunction(_x + 0.5, _y + 1);
+                int _y = max(_y0, _rowMin),
+                    _yEnd = min(min(_height, _y1), _rowMax);
+                if (_y > _yEnd)
+                {
+                    return;
+                }
+                int _x = static_cast<int>(_ceilDiv(_dx2 * _y + 2 * _c - _y1_y0, _dy2));
+                Float _d = _line(_x + 0.5, _y + 1);
 
                 Float _dt = sqrt((Float(1) / (k * k) + 1) / (_x1_x0 * _x1_x0 + _y1_y0 * _y1_y0));
                 Float _ddepth = _dt * (_v1->position[2] - _v0->position[2]);
-                for (; _y <= _yMax; _y++)
+                _t = (_y - _y0) * _dt;
+                _depth += (_y - _y0) * _ddepth;
+                for (; _y <= _yEnd; _y++)
                 {
-                    if (_y >= 0 && _y < _outColorMap->getHeight() &&
-                        _x >= 0 && _x < _outColorMap->getWidth())
+                    if (_y < _height && _x >= 0 && _x < _width)
                     {
                         putPixel(_x, _y, _t, _outColorMap, _depthBuffer);
                     }
@@ -176,21 +234,20 @@ namespace lightroom
             int _x, int _y, Float _t,
             WritableColorMap* _colorMap, DepthBuffer& _depthBuffer) const
         {
-            int _index = _y * _colorMap->getWidth() + _x;
+            size_t _index = _colorMap->indexOf(_x, _y);
 
             _colorMap->set(_index, Color(1, 1, 1, 1));
         }
 
     protected:
-        inline Float _lineFunction(Float _x, Float _y) const
+        // Floor and ceiling of _a / _b for _b > 0
+        inline static int64_t _floorDiv(int64_t _a, int64_t _b)
         {
-            auto& _p0 = _vertices[0]->position;
-            auto& _p1 = _vertices[1]->position;
-            int _x0 = _p0[0],
-                _y0 = _p0[1],
-                _x1 = _p1[0],
-                _y1 = _p1[1];
-            return (_x1 - _x0) * _y - (_y1 - _y0) * _x - _x1 * _y0 + _x0 * _y1;
+            return _a / _b - (_a % _b < 0);
+        }
+        inline static int64_t _ceilDiv(int64_t _a, int64_t _b)
+        {
+            return -_floorDiv(-_a, _b);
         }
 
     private:
@@ -208,10 +265,34 @@ namespace lightroom
     {
     protected:
         std::array<_VertexType*, 3> _vertices;
+        mutable const Material* _material = nullptr;
     private:
         mutable Float _nplain;
         mutable Float _fplain;
 
+        // Per-draw constants of the raster loops
+        struct RasterSetup
+        {
+            int xMin, xMax, yMin, yMax;
+            Float beta, gamma;              // at (xMin, yMin)
+            Float dbetax, dbetay, dgammax, dgammay;
+            Float area;                     // signed, doubled, in screen space
+            Float z[3];
+            Float inverseZ[3];              // proportional to 1 / view depth, for perspective weights
+        };
+        // Pixels that passed the depth test, waiting to be shaded eight at a time
+        struct ShadeQueue
+        {
+            int count = 0;
+            int x[8], y[8];
+            Float alpha[8], beta[8], gamma[8];
+            size_t index[8];
+        };
+        using Kernel = void (Triangle3D::*)(const RasterSetup&, WritableColorMap*, DepthBuffer&, int, int) const;
+
+        mutable RasterSetup _setup;
+        mutable Kernel _kernel = nullptr;  // null when prepare() found nothing to draw
+
     public:
         Triangle3D(const std::array<_VertexType*, 3>& _vs) : _vertices(_vs)
         {
@@ -244,17 +325,21 @@ namespace lightroom
             return ((_p1 - _p0).cross(_p2 - _p0)).normalized();
         }
 
-        virtual inline void draw(
-            WritableColorMap* _outColorMap,
-            DepthBuffer& _depthBuffer,
-            Float _nplain, Float _fplain) const override final
+        // Triangle setup, culling and the material's setup(); selects the raster loop for _state
+        virtual inline void prepare(
+            const WritableColorMap* _outColorMap,
+            Float _nplain, Float _fplain,
+            const Material* _material,
+            const PipelineState& _state) const override final
         {
+            _kernel = nullptr;
             if (!isVaild())
             {
                 return;
             }
             this->_nplain = _nplain;
             this->_fplain = _fplain;
+            this->_material = _material;
 
             auto& _p0 = _vertices[0]->position;
             auto& _p1 = _vertices[1]->position;
@@ -284,43 +369,42 @@ namespace lightroom
                 _e = _xMin - _x0,
                 _f = _yMin - _y0;
             Float _M = _a * _d - _b * _c;
-            Float _beta = (_e * _d - _b * _f) / _M;
-            Float _gamma = (_a * _f - _c * _e) / _M;
-            Float _alpha = 1 - _beta - _gamma;
-
-            Float _dbetax = _d / _M;
-            Float _dbetay = -_b / _M;
-            Float _dgammax = -_c / _M;
-            Float _dgammay = _a / _M;
-
-            for (int _x = _xMin; _x <= _xMax; _x++)
+            if (_M == 0)
             {
-                Float __beta = _beta;
-                Float __gamma = _gamma;
-                for (int _y = _yMin; _y <= _yMax; _y++)
-                {
-                    if ((unsigned)_y >= _outColorMap->getHeight() ||
-                        (unsigned)_x >= _outColorMap->getWidth())
-                    {
-                        continue;
-                    }
-                    __beta += _dbetay;
-                    __gamma += _dgammay;
-
-                    if (__beta < 0 || __beta > 1)
-                    {
-                        continue;
-                    }
-                    if (__gamma < 0 || __gamma > 1 || __beta + __gamma > 1)
-                    {
-                        continue;
-                    }
-                    Float __alpha = 1 - __beta - __gamma;
-
-                    putPixel(_x, _y, __alpha, __beta, __gamma, _outColorMap, _depthBuffer);
-                }
-                _beta += _dbetax;
-                _gamma += _dgammax;
+                return;
+            }
+            // screen y points down, so faces counter-clockwise with y up have a negative area here
+            if ((_state.cull == CullMode::BACK && _M > 0) || (_state.cull == CullMode::FRONT && _M < 0))
+            {
+                return;
+            }
+            _setup.xMin = _xMin;
+            _setup.xMax = _xMax;
+            _setup.yMin = _yMin;
+            _setup.yMax = _yMax;
+            _setup.beta = (_e * _d - _b * _f) / _M;
+            _setup.gamma = (_a * _f - _c * _e) / _M;
+            _setup.dbetax = _d / _M;
+            _setup.dbetay = -_b / _M;
+            _setup.dgammax = -_c / _M;
+            _setup.dgammay = _a / _M;
+            _setup.area = _M;
+            for (int _i = 0; _i < 3; _i++)
+            {
+                _setup.z[_i] = _vertices[_i]->position[2];
+                _setup.inverseZ[_i] = _nplain + _fplain - _setup.z[_i] * (_nplain - _fplain);
+            }
+            setup(_setup.dbetax, _setup.dbetay, _setup.dgammax, _setup.dgammay);
+            _kernel = _selectKernel(_state);
+        }
+        virtual inline void drawRows(
+            WritableColorMap* _outColorMap,
+            DepthBuffer& _depthBuffer,
+            int _rowMin, int _rowMax) const override final
+        {
+            if (_kernel && _rowMin <= _setup.yMax && _rowMax >= _setup.yMin)
+            {
+                (this->*_kernel)(_setup, _outColorMap, _depthBuffer, _rowMin, _rowMax);
             }
         }
     protected:
@@ -352,15 +436,276 @@ namespace lightroom
                 _func(_vertices[1]) * _beta  *  (_1_Z1 / _1_Zp) +
                 _func(_vertices[2]) * _gamma *  (_1_Z2 / _1_Zp);
         }
-        virtual inline void putPixel(
-            int _x, int _y, Float _alpha, Float _beta, Float _gamma,
-            WritableColorMap* _colorMap, DepthBuffer& _depthBuffer) const
+        // Called once per draw before rasterization with the screen-space
+        // derivatives of the barycentric coordinates; _material is already resolved
+        virtual inline void setup(Float _dbetadx, Float _dbetady,
+                                  Float _dgammadx, Float _dgammady) const {}
+        // Colour of a pixel that passed the depth test. The barycentrics are already weighted
+        // for the draw's Interpolation, so attributes are a plain linearInterpolation of them.
+        virtual inline Color shade(int _x, int _y, Float _alpha, Float _beta, Float _gamma) const
+        {
+            return Color(1, 1, 1, 1);
+        }
+        // shade() for _count pixels, at most eight, of one draw; the rasterizer always calls this.
+        // Overridden where a batch is cheaper than single pixels, e.g. with TextureSampler::sample8.
+        virtual inline void shade8(const int* _x, const int* _y, const Float* _alpha, const Float* _beta,
+                                   const Float* _gamma, int _count, Color* _out) const
         {
-            int _index = _y * _colorMap->getWidth() + _x;
+            for (int _i = 0; _i < _count; _i++)
+            {
+                _out[_i] = shade(_x[_i], _y[_i], _alpha[_i], _beta[_i], _gamma[_i]);
+            }
+        }
 
-            _colorMap->set(_index, Color(1, 1, 1, 1));
+    private:
+        // Culling is decided per primitive in prepare(), so the table covers the other four fields
+        static constexpr size_t _KERNEL_COUNT = PipelineState::COMBINATIONS / 3;
+
+        template <size_t... _I>
+        static constexpr std::array<Kernel, sizeof...(_I)> _makeKernels(std::index_sequence<_I...>)
+        {
+            // decodes PipelineState::index() below the cull mode
+            return { &Triangle3D::_rasterize<static_cast<DepthTest>(_I / 8 % 2), _I / 4 % 2 != 0,
+                                             static_cast<BlendMode>(_I / 2 % 2), static_cast<Interpolation>(_I % 2)>... };
+        }
+        inline static Kernel _selectKernel(const PipelineState& _state)
+        {
+            static constexpr auto _kernels = _makeKernels(std::make_index_sequence<_KERNEL_COUNT>{});
+            return _kernels[_state.index() % _KERNEL_COUNT];
+        }
+
+        template <DepthTest _TEST, bool _WRITE, BlendMode _BLEND, Interpolation _INTERP>
+        void _rasterize(const RasterSetup& _s, WritableColorMap* _outColorMap, DepthBuffer& _depthBuffer,
+                        int _rowMin, int _rowMax) const
+        {
+            int _yMin = max(_s.yMin, _rowMin), _yMax = min(_s.yMax, _rowMax);
+            if (_depthBuffer.isCompressed())
+            {
+                // pixel (x, y) takes the barycentrics of (x, y + 1), like the column walk below
+                _drawTiles<_TEST, _WRITE, _BLEND, _INTERP>(_s, _outColorMap, _depthBuffer,
+                                                           _s.xMin, min(_s.xMax, _outColorMap->getWidth() - 1),
+                                                           _yMin, min(_yMax, _outColorMap->getHeight() - 1),
+                                                           _s.beta + _s.dbetay, _s.gamma + _s.dgammay);
+                return;
+            }
+
+            ShadeQueue _queue;
+            Float _beta = _s.beta;
+            Float _gamma = _s.gamma;
+            for (int _x = _s.xMin; _x <= _s.xMax; _x++)
+            {
+                for (int _y = _yMin; _y <= _yMax; _y++)
+                {
+                    if ((unsigned)_y >= _outColorMap->getHeight() ||
+                        (unsigned)_x >= _outColorMap->getWidth())
+                    {
+                        continue;
+                    }
+                    // from the column's start rather than accumulated, so a band of rows gets the
+                    // same weights as the whole walk
+                    Float __beta = _beta + (_y + 1 - _s.yMin) * _s.dbetay;
+                    Float __gamma = _gamma + (_y + 1 - _s.yMin) * _s.dgammay;
+
+                    if (__beta < 0 || __beta > 1)
+                    {
+                        continue;
+                    }
+                    if (__gamma < 0 || __gamma > 1 || __beta + __gamma > 1)
+                    {
+                        continue;
+                    }
+                    Float __alpha = 1 - __beta - __gamma;
+
+                    size_t _index = _outColorMap->indexOf(_x, _y);
+                    if (!_depthPass<_TEST, _WRITE>(_s, _depthBuffer, _index, __alpha, __beta, __gamma))
+                    {
+                        continue;
+                    }
+                    _queuePixel<_BLEND, _INTERP>(_s, _x, _y, __alpha, __beta, __gamma, _outColorMap, _index, _queue);
+                }
+                _beta += _s.dbetax;
+                _gamma += _s.dgammax;
+            }
+            _shadeQueued<_BLEND>(_outColorMap, _queue);
+        }
+
+        template <DepthTest _TEST, bool _WRITE>
+        inline bool _depthPass(const RasterSetup& _s, DepthBuffer& _depthBuffer, size_t _index,
+                               Float _alpha, Float _beta, Float _gamma) const
+        {
+            if constexpr (_TEST == DepthTest::ALWAYS && !_WRITE)
+            {
+                return true;
+            }
+            else
+            {
+                Float _depth = _alpha * _s.z[0] + _beta * _s.z[1] + _gamma * _s.z[2];
+                if constexpr (_TEST == DepthTest::NEARER)
+                {
+                    // read through the const overload, which never expands a compressed tile
+                    if (_depth <= std::as_const(_depthBuffer)[_index])
+                    {
+                        return false;
+                    }
+                }
+                if constexpr (_WRITE)
+                {
+                    _depthBuffer[_index] = _depth;
+                }
+                return true;
+            }
+        }
+
+        template <BlendMode _BLEND, Interpolation _INTERP>
+        inline void _queuePixel(const RasterSetup& _s, int _x, int _y, Float _alpha, Float _beta, Float _gamma,
+                                WritableColorMap* _outColorMap, size_t _index, ShadeQueue& _queue) const
+        {
+            if constexpr (_INTERP == Interpolation::PERSPECTIVE)
+            {
+                Float _w0 = _alpha * _s.inverseZ[0], _w1 = _beta * _s.inverseZ[1], _w2 = _gamma * _s.inverseZ[2];
+                Float _inverse = 1 / (_w0 + _w1 + _w2);
+                _alpha = _w0 * _inverse;
+                _beta = _w1 * _inverse;
+                _gamma = _w2 * _inverse;
+            }
+            int _i = _queue.count++;
+            _queue.x[_i] = _x;
+            _queue.y[_i] = _y;
+            _queue.alpha[_i] = _alpha;
+            _queue.beta[_i] = _beta;
+            _queue.gamma[_i] = _gamma;
+            _queue.index[_i] = _index;
+            if (_queue.count == 8)
+            {
+                _shadeQueued<_BLEND>(_outColorMap, _queue);
+            }
+        }
+        // A triangle covers each pixel once, so queued pixels may be written in any order
+        template <BlendMode _BLEND>
+        inline void _shadeQueued(WritableColorMap* _outColorMap, ShadeQueue& _queue) const
+        {
+            if (!_queue.count)
+            {
+                return;
+            }
+            Color _colors[8];
+            shade8(_queue.x, _queue.y, _queue.alpha, _queue.beta, _queue.gamma, _queue.count, _colors);
+            for (int _i = 0; _i < _queue.count; _i++)
+            {
+                if constexpr (_BLEND == BlendMode::ALPHA)
+                {
+                    _colors[_i] = alphaMix(_colors[_i], _outColorMap->get(_queue.index[_i]));
+                    _colors[_i]._rgba[3] = 1;
+                }
+                _outColorMap->set(_queue.index[_i], _colors[_i]);
+            }
+            _queue.count = 0;
+        }
+
+        // Rasterizes one depth tile at a time over the pixel rect [_xMin, _xMax] x [_yMin, _yMax];
+        // _beta and _gamma are taken at (_s.xMin, _s.yMin), so a band of rows clips the rect without
+        // moving the origin the weights are measured from. With the NEARER test a tile the
+        // triangle can not win anywhere is skipped, and when depth is written a tile it covers
+        // and wins everywhere is stored as a plane without touching per-pixel depth.
+        template <DepthTest _TEST, bool _WRITE, BlendMode _BLEND, Interpolation _INTERP>
+        inline void _drawTiles(const RasterSetup& _s, WritableColorMap* _outColorMap, DepthBuffer& _depthBuffer,
+                               int _xMin, int _xMax, int _yMin, int _yMax, Float _beta, Float _gamma) const
+        {
+            constexpr int _tileSize = PixelLayout::TILE_SIZE;
+            auto& _layout = _depthBuffer.getLayout();
+            Float _z0 = _s.z[0];
+            Float _dz1 = _s.z[1] - _z0, _dz2 = _s.z[2] - _z0;
+            Float _dzdx = _s.dbetax * _dz1 + _s.dgammax * _dz2, _dzdy = _s.dbetay * _dz1 + _s.dgammay * _dz2;
+            auto _betaAt = [&](int _x, int _y)
+            {
+                return _beta + (_x - _s.xMin) * _s.dbetax + (_y - _s.yMin) * _s.dbetay;
+            };
+            auto _gammaAt = [&](int _x, int _y)
+            {
+                return _gamma + (_x - _s.xMin) * _s.dgammax + (_y - _s.yMin) * _s.dgammay;
+            };
+            ShadeQueue _queue;
+
+            for (int _ty = _yMin / _tileSize; _ty * _tileSize <= _yMax; _ty++)
+            {
+                for (int _tx = _xMin / _tileSize; _tx * _tileSize <= _xMax; _tx++)
+                {
+                    int _x0 = max(_tx * _tileSize, _xMin), _x1 = min(_tx * _tileSize + _tileSize - 1, _xMax);
+                    int _y0 = max(_ty * _tileSize, _yMin), _y1 = min(_ty * _tileSize + _tileSize - 1, _yMax);
+
+                    // barycentrics and depth are linear, so the rect's corners bound them
+                    int _outBeta = 0, _outGamma = 0, _outSum = 0, _inside = 0;
+                    Float _zMin = std::numeric_limits<Float>::infinity(), _zMax = -_zMin;
+                    for (int _c = 0; _c < 4; _c++)
+                    {
+                        int _cx = (_c & 1) ? _x1 : _x0, _cy = (_c & 2) ? _y1 : _y0;
+                        Float _b = _betaAt(_cx, _cy), _g = _gammaAt(_cx, _cy);
+                        _outBeta += _b < 0;
+                        _outGamma += _g < 0;
+                        _outSum += _b + _g > 1;
+                        _inside += _b >= 0 && _g >= 0 && _b + _g <= 1;
+                        Float _z = _z0 + _b * _dz1 + _g * _dz2;
+                        _zMin = min(_zMin, _z);
+                        _zMax = max(_zMax, _z);
+                    }
+                    size_t _tile = static_cast<size_t>(_ty) * _layout.tilesX + _tx;
+                    if (_outBeta == 4 || _outGamma == 4 || _outSum == 4)
+                    {
+                        continue;
+                    }
+                    if constexpr (_TEST == DepthTest::NEARER)
+                    {
+                        if (_zMax <= _depthBuffer.getTileMin(_tile))
+                        {
+                            continue;
+                        }
+                    }
+
+                    bool _planar = false;
+                    if constexpr (_WRITE)
+                    {
+                        bool _wholeTile = _x0 == _tx * _tileSize && _x1 == _x0 + _tileSize - 1 &&
+                            _y0 == _ty * _tileSize && _y1 == _y0 + _tileSize - 1;
+                        _planar = _inside == 4 && _wholeTile &&
+                            (_TEST == DepthTest::ALWAYS || _zMin > _depthBuffer.getTileMax(_tile));
+                        if (_planar)
+                        {
+                            Float _z = _z0 + _betaAt(_x0, _y0) * _dz1 + _gammaAt(_x0, _y0) * _dz2;
+                            _depthBuffer.setTilePlane(_tile, { _z, _dzdx, _dzdy, _zMin, _zMax });
+                        }
+                    }
+                    for (int _x = _x0; _x <= _x1; _x++)
+                    {
+                        for (int _y = _y0; _y <= _y1; _y++)
+                        {
+                            Float _b = _betaAt(_x, _y), _g = _gammaAt(_x, _y);
+                            if (!_planar && (_b < 0 || _b > 1 || _g < 0 || _g > 1 || _b + _g > 1))
+                            {
+                                continue;
+                            }
+                            Float _a = 1 - _b - _g;
+                            size_t _index = _outColorMap->indexOf(_x, _y);
+                            if (!_planar && !_depthPass<_TEST, _WRITE>(_s, _depthBuffer, _index, _a, _b, _g))
+                            {
+                                continue;
+                            }
+                            _queuePixel<_BLEND, _INTERP>(_s, _x, _y, _a, _b, _g, _outColorMap, _index, _queue);
+                        }
+                    }
+                    if constexpr (_TEST == DepthTest::ALWAYS && _WRITE)
+                    {
+                        // untested writes may have gone below the tile's bound, which the
+                        // NEARER skip above relies on
+                        if (!_planar)
+                        {
+                            _depthBuffer.lowerTileMin(_tile, _zMin);
+                        }
+                    }
+                }
+            }
+            _shadeQueued<_BLEND>(_outColorMap, _queue);
         }
 
     };
 
-};
\ No newline at end of file
+};
@@ -28,6 +28,24 @@ namespace lightroom
         {
             return static_cast<COLORREF>(*this);
         }
+        // toRGBColor() over an array, with the widest kernel CpuFeatures::getIsa() allows
+        inline static void pack(const Color* _colors, COLORREF* _out, size_t _count)
+        {
+            switch (CpuFeatures::getIsa())
+            {
+                case IsaLevel::AVX512:
+                    _packAvx512(_colors, _out, _count);
+                    break;
+                case IsaLevel::AVX2:
+                    _packAvx2(_colors, _out, _count);
+                    break;
+                case IsaLevel::SSE42:
+                    _packSse42(_colors, _out, _count);
+                    break;
+                default:
+                    _packScalar(_colors, _out, _count);
+            }
+        }
 
         inline Float& operator[](size_t _index)
         {
@@ -37,6 +55,80 @@ namespace lightroom
         {
             return _rgba[_index];
         }
+    protected:
+        // Variants of pack(). Channels are clamped to 255 before the truncating conversion, as in
+        // the scalar cast; each variant leaves the colours past its last full block to a narrower one.
+        inline static void _packScalar(const Color* _colors, COLORREF* _out, size_t _count)
+        {
+            for (size_t _i = 0; _i < _count; _i++)
+            {
+                _out[_i] = _colors[_i].toRGBColor();
+            }
+        }
+        // Four colours as int32 r, g, b, a to four pixels; the saturating packs clamp below at 0
+        LIGHTROOM_TARGET("sse4.2") inline static __m128i _packPixels4(__m128i _c0, __m128i _c1, __m128i _c2, __m128i _c3)
+        {
+            const __m128i _order = _mm_setr_epi8(2, 1, 0, -128, 6, 5, 4, -128, 10, 9, 8, -128, 14, 13, 12, -128);
+            __m128i _bytes = _mm_packus_epi16(_mm_packus_epi32(_c0, _c1), _mm_packus_epi32(_c2, _c3));
+            return _mm_shuffle_epi8(_bytes, _order);
+        }
+        LIGHTROOM_TARGET("sse4.2") inline static void _packSse42(const Color* _colors, COLORREF* _out, size_t _count)
+        {
+            static_assert(sizeof(Color) == 4 * sizeof(double) && sizeof(COLORREF) == 4);
+            const __m128d _scale = _mm_set1_pd(256), _top = _mm_set1_pd(255);
+            size_t _i = 0;
+            for (; _i + 4 <= _count; _i += 4)
+            {
+                __m128i _c[4];
+                for (int _k = 0; _k < 4; _k++)
+                {
+                    const double* _rgba = _colors[_i + _k]._rgba;
+                    __m128i _rg = _mm_cvttpd_epi32(_mm_min_pd(_mm_mul_pd(_mm_loadu_pd(_rgba), _scale), _top));
+                    __m128i _ba = _mm_cvttpd_epi32(_mm_min_pd(_mm_mul_pd(_mm_loadu_pd(_rgba + 2), _scale), _top));
+                    _c[_k] = _mm_unpacklo_epi64(_rg, _ba);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + _i), _packPixels4(_c[0], _c[1], _c[2], _c[3]));
+            }
+            _packScalar(_colors + _i, _out + _i, _count - _i);
+        }
+        // One colour per register
+        LIGHTROOM_TARGET("avx2") inline static void _packAvx2(const Color* _colors, COLORREF* _out, size_t _count)
+        {
+            const __m256d _scale = _mm256_set1_pd(256), _top = _mm256_set1_pd(255);
+            size_t _i = 0;
+            for (; _i + 4 <= _count; _i += 4)
+            {
+                __m128i _c[4];
+                for (int _k = 0; _k < 4; _k++)
+                {
+                    __m256d _rgba = _mm256_loadu_pd(_colors[_i + _k]._rgba);
+                    _c[_k] = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_mul_pd(_rgba, _scale), _top));
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + _i), _packPixels4(_c[0], _c[1], _c[2], _c[3]));
+            }
+            _packScalar(_colors + _i, _out + _i, _count - _i);
+        }
+        // Two colours per register
+        LIGHTROOM_TARGET("avx512f") inline static void _packAvx512(const Color* _colors, COLORREF* _out, size_t _count)
+        {
+            const __m512d _scale = _mm512_set1_pd(256), _top = _mm512_set1_pd(255);
+            size_t _i = 0;
+            for (; _i + 8 <= _count; _i += 8)
+            {
+                __m128i _c[8];
+                for (int _k = 0; _k < 8; _k += 2)
+                {
+                    __m512d _pair = _mm512_loadu_pd(_colors[_i + _k]._rgba);
+                    __m256i _channels = _mm512_cvttpd_epi32(_mm512_min_pd(_mm512_mul_pd(_pair, _scale), _top));
+                    _c[_k] = _mm256_castsi256_si128(_channels);
+                    _c[_k + 1] = _mm256_extracti128_si256(_channels, 1);
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + _i), _packPixels4(_c[0], _c[1], _c[2], _c[3]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + _i + 4), _packPixels4(_c[4], _c[5], _c[6], _c[7]));
+            }
+            _packAvx2(_colors + _i, _out + _i, _count - _i);
+        }
+
     public:
         inline friend Color alphaMix(const Color& _fore, const Color& _back)
         {
@@ -122,16 +214,34 @@ namespace lightroom
             return _size[1];
         }
     };
+    // Indices passed to get and set follow the map's PixelLayout; use indexOf to compute them
     class WritableColorMap : public ColorMap
     {
+    protected:
+        PixelLayout _layout;
     public:
-        WritableColorMap(const PxCoordinate& _size = { 0,0 }) : ColorMap(_size) {}
+        WritableColorMap(const PxCoordinate& _size = { 0,0 }, bool _tiled = false) :
+            ColorMap(_size), _layout(_size, _tiled) {}
         virtual ~WritableColorMap() {}
 
+        using ColorMap::get;
+        Color get(const PxCoordinate& _position) const
+        {
+            return get(indexOf(_position[0], _position[1]));
+        }
         virtual void set(size_t _index, const Color& _color) = 0;
         void set(const PxCoordinate& _position, const Color& _color)
         {
-            set(_size[0] * _position[1] + _position[0], _color);
+            set(indexOf(_position[0], _position[1]), _color);
+        }
+
+        inline size_t indexOf(int _x, int _y) const
+        {
+            return _layout.index(_x, _y);
+        }
+        inline const PixelLayout& getLayout() const
+        {
+            return _layout;
         }
     };
 
@@ -147,54 +257,191 @@ namespace lightroom
             return _color;
         }
     };
+    // Colour buffer whose background is resolved up front: a solid background is a plain fill
+    // on wipe(), any other background is composited once into a backdrop that wipe() copies.
+    // Writes are blended over the background as they land, so reads are a plain load.
+    // With _tiled the buffer uses the tiled PixelLayout; Viewport::print de-tiles it.
+    // With _owners the rows are split into bands one tile high, each worker of _owners owning a
+    // contiguous run of them, and every band is first written by its owner so that its pages sit
+    // on that worker's NUMA node. Renderers drawing or resolving on the same job system hand each
+    // worker its own bands; pin the workers (NumaTopology::getAffinity()) for this to pay off.
     class SequenceMap : public WritableColorMap
     {
     protected:
-        class OverwriteMask : public std::vector<int>
+        std::vector<Color, FirstTouchAllocator<Color>> _data;
+        std::vector<Color> _backdrop;   // resolved non-solid background, empty otherwise
+        Color _clearColor;
+        ColorMap* _background;
+        JobSystem* _owners;
+    public:
+        SequenceMap(const PxCoordinate& _size, ColorMap* _background = nullptr, bool _tiled = false,
+                    JobSystem* _owners = nullptr) :
+            WritableColorMap(_size, _tiled), _data(_layout.storageSize()), _background(nullptr), _owners(_owners)
         {
-        public:
-            template <typename... _Args>
-            OverwriteMask(_Args&&... _args) : std::vector<int>(_args...) {}
-            void clear()
+            if (_owners)
             {
-                std::fill(begin(), end(), false);
+                _owners->forEachWorker([this](unsigned _worker)
+                {
+                    auto [_first, _last] = getOwnedRows(_worker);
+                    auto [_begin, _end] = _layout.storageOf(_first, _last);
+                    std::fill(_data.begin() + _begin, _data.begin() + _end, Color());
+                });
             }
-        };
-
-        std::vector<Color> _data;
-        OverwriteMask _mask;
-        ColorMap* _background;
-    public:
-        SequenceMap(const PxCoordinate& _size, ColorMap* _background = nullptr) :
-            WritableColorMap(_size), _data(_size[0] * _size[1]), _mask(_size[0] * _size[1]), _background(_background) {}
+            else
+            {
+                std::fill(_data.begin(), _data.end(), Color());
+            }
+            setBackground(_background);
+        }
         virtual ~SequenceMap() {}
 
+        using WritableColorMap::get;
+        using WritableColorMap::set;
         virtual Color get(size_t _index) const override
         {
-            auto _backgroundColor = (_background ? _background->get(_index) : Color(0, 0, 0, 1));
-            return (_mask[_index] == true) ?
-                alphaMix(_data[_index], std::move(_backgroundColor)) : std::move(_backgroundColor);
+            return _data[_index];
         }
         virtual void set(size_t _index, const Color& _color) override
         {
-            _mask[_index] = true;
-            _data[_index] = _color;
+            _data[_index] = _color[3] >= 1 ? _color :
+                alphaMix(_color, _backdrop.empty() ? _clearColor : _backdrop[_index]);
         }
         void wipe()
         {
-            _mask.clear();
+            if (_backdrop.empty())
+            {
+                _fill(_data.data(), _data.size(), _clearColor);
+            }
+            else
+            {
+                std::copy(_backdrop.begin(), _backdrop.end(), _data.begin());
+            }
+        }
+
+        inline const Color* data() const
+        {
+            return _data.data();
+        }
+        inline ColorMap* getBackground() const
+        {
+            return _background;
+        }
+
+        inline JobSystem* getOwners() const
+        {
+            return _owners;
+        }
+        // Rows [first, second) owned by worker _worker of getOwners(); all rows without owners
+        std::pair<int, int> getOwnedRows(unsigned _worker) const
+        {
+            return _layout.getBandRows(_worker, _owners ? max(1u, _owners->getThreadCount()) : 1);
+        }
+        unsigned getRowOwner(int _y) const
+        {
+            unsigned _last = _owners ? max(1u, _owners->getThreadCount()) - 1 : 0;
+            for (unsigned _worker = 0; _worker < _last; _worker++)
+            {
+                if (_y < getOwnedRows(_worker).second)
+                {
+                    return _worker;
+                }
+            }
+            return _last;
+        }
+        // Bytes of the buffer resident on each NUMA node, plus one last entry for pages not yet
+        // touched or whose node is unknown; see NumaTopology::getResidentBytes()
+        std::vector<size_t> getResidentBytes() const
+        {
+            return NumaTopology::get().getResidentBytes(_data.data(), _data.size() * sizeof(Color));
+        }
+        // Resolves the new background and wipes the map
+        void setBackground(ColorMap* _background)
+        {
+            this->_background = _background;
+            updateBackground();
+        }
+        // Composites the background again, for backgrounds whose content changed; wipes the map
+        void updateBackground()
+        {
+            auto _solid = dynamic_cast<SolidMap*>(_background);
+            _clearColor = _solid ? _solid->get(size_t(0)) : Color(0, 0, 0, 1);
+            if (_background && !_solid)
+            {
+                _backdrop.resize(_data.size());
+                for (int _y = 0; _y < _size[1]; _y++)
+                {
+                    for (int _x = 0; _x < _size[0]; _x++)
+                    {
+                        _backdrop[indexOf(_x, _y)] = _background->get(static_cast<size_t>(_y) * _size[0] + _x);
+                    }
+                }
+            }
+            else
+            {
+                _backdrop.clear();
+                _backdrop.shrink_to_fit();
+            }
+            wipe();
+        }
+
+    protected:
+        // A Color is four doubles, exactly one AVX register. Chosen at run time: the project
+        // builds without /arch:AVX, so MSVC never defines __AVX__ and a compile-time check
+        // would always take the scalar fill.
+        inline static void _fill(Color* _begin, size_t _count, const Color& _color)
+        {
+            switch (CpuFeatures::getIsa())
+            {
+                case IsaLevel::AVX512:
+                    _fillAvx512(_begin, _count, _color);
+                    break;
+                case IsaLevel::AVX2:
+                    _fillAvx2(_begin, _count, _color);
+                    break;
+                default:
+                    std::fill(_begin, _begin + _count, _color);
+            }
+        }
+        LIGHTROOM_TARGET("avx2") inline static void _fillAvx2(Color* _begin, size_t _count, const Color& _color)
+        {
+            static_assert(sizeof(Color) == sizeof(__m256d));
+            __m256d _value = _mm256_loadu_pd(&_color._rgba[0]);
+            double* _out = &_begin->_rgba[0];
+            for (size_t _i = 0; _i < _count; _i++)
+            {
+                _mm256_storeu_pd(_out + 4 * _i, _value);
+            }
+        }
+        // Two colours per store
+        LIGHTROOM_TARGET("avx512f") inline static void _fillAvx512(Color* _begin, size_t _count, const Color& _color)
+        {
+            __m256d _value = _mm256_loadu_pd(&_color._rgba[0]);
+            __m512d _pair = _mm512_insertf64x4(_mm512_castpd256_pd512(_value), _value, 1);
+            double* _out = &_begin->_rgba[0];
+            size_t _i = 0;
+            for (; _i + 2 <= _count; _i += 2)
+            {
+                _mm512_storeu_pd(_out + 4 * _i, _pair);
+            }
+            if (_i < _count)
+            {
+                _mm256_storeu_pd(_out + 4 * _i, _value);
+            }
         }
     };
     class ImageMap : public ColorMap
     {
     protected:
         IMAGE* _image;
+        DWORD* _buffer;
     public:
-        ImageMap(const wchar_t* _fileName, const PxCoordinate& _size) : ColorMap(_size)
+        // A zero _size keeps the image's own dimensions
+        ImageMap(const wchar_t* _fileName, const PxCoordinate& _size = { 0, 0 }) : ColorMap(_size)
         {
             _image = new IMAGE;
             loadimage(_image, _fileName, _size[0], _size[1], true);
-            
+            _buffer = GetImageBuffer(_image);
+            this->_size = { _image->getwidth(), _image->getheight() };
         }
         virtual ~ImageMap()
         {
@@ -203,8 +450,7 @@ namespace lightroom
 
         virtual Color get(size_t _index) const override
         {
-            auto _data = GetImageBuffer(_image);
-            return Color(_data[_index]);
+            return Color(_buffer[_index]);
         }
     };
 };
\ No newline at end of file
@@ -13,22 +13,274 @@ namespace lightroom
     class Line3D;
     template <typename _T> requires std::is_convertible_v<const _T*, const  Vertex3D*> 
     class Triangle3D;
+    struct Material;
+    using MaterialId = uint16_t;
 
     enum class PrimitiveInputType : uint8_t
     {
         NONE, LINES, LINE_STRIP, LINE_LOOP, TRIANGLE_STRIP, TRIANGLE_FAN
     };
+
+    // Front faces wind counter-clockwise on screen, as seen with y pointing up
+    enum class CullMode : uint8_t
+    {
+        NONE, BACK, FRONT
+    };
+    enum class DepthTest : uint8_t
+    {
+        ALWAYS, NEARER
+    };
+    enum class BlendMode : uint8_t
+    {
+        REPLACE, ALPHA      // ALPHA mixes the shaded colour over what the target holds
+    };
+    enum class Interpolation : uint8_t
+    {
+        LINEAR, PERSPECTIVE
+    };
+    // Fixed-function state of a draw. Every combination has its own triangle raster loop,
+    // chosen once per triangle, so no pixel branches on it.
+    struct PipelineState
+    {
+        static constexpr size_t COMBINATIONS = 3 * 2 * 2 * 2 * 2;
+
+        CullMode cull = CullMode::NONE;
+        DepthTest depthTest = DepthTest::NEARER;
+        bool depthWrite = true;
+        BlendMode blend = BlendMode::REPLACE;
+        Interpolation interpolation = Interpolation::PERSPECTIVE;
+
+        // Position in the raster kernel table
+        constexpr size_t index() const
+        {
+            return (((static_cast<size_t>(cull) * 2 + static_cast<size_t>(depthTest)) * 2 + depthWrite) * 2 +
+                    static_cast<size_t>(blend)) * 2 + static_cast<size_t>(interpolation);
+        }
+    };
     using PxCoordinate = Eigen::Matrix<int, 2, 1>;
     using UVCoordinate = Eigen::Matrix<Float, 2, 1>;
 
-    class DepthBuffer : public std::vector<Float>
+    // Maps pixel coordinates to buffer indices, shared by a colour target and its depth buffer.
+    // The tiled layout keeps each 8x8 tile contiguous, tiles in row-major order and pixels in
+    // Morton order inside a tile, so tile-local raster work stays within a few cache lines.
+    struct PixelLayout
+    {
+        static constexpr int TILE_SHIFT = 3;
+        static constexpr int TILE_SIZE = 1 << TILE_SHIFT;
+        static constexpr int TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+        PxCoordinate size;
+        bool tiled;
+        int tilesX;
+        int tilesY;
+
+        PixelLayout(const PxCoordinate& size = { 0, 0 }, bool tiled = false) :
+            size(size), tiled(tiled),
+            tilesX((size[0] + TILE_SIZE - 1) >> TILE_SHIFT), tilesY((size[1] + TILE_SIZE - 1) >> TILE_SHIFT) {}
+
+        // Spreads the three low bits of _v to even bit positions
+        inline static constexpr uint32_t spread(uint32_t _v)
+        {
+            return (_v & 1) | ((_v & 2) << 1) | ((_v & 4) << 2);
+        }
+        inline size_t index(int _x, int _y) const
+        {
+            if (!tiled)
+            {
+                return static_cast<size_t>(_y) * size[0] + _x;
+            }
+            size_t _tile = static_cast<size_t>(_y >> TILE_SHIFT) * tilesX + (_x >> TILE_SHIFT);
+            return (_tile << (2 * TILE_SHIFT)) |
+                spread(_x & (TILE_SIZE - 1)) | (spread(_y & (TILE_SIZE - 1)) << 1);
+        }
+        // Tiled storage is padded out to whole tiles
+        inline size_t storageSize() const
+        {
+            return tiled ? static_cast<size_t>(tilesX) * tilesY * TILE_PIXELS : static_cast<size_t>(size[0]) * size[1];
+        }
+        // Rows [first, second) of part _part when the rows are dealt out as bands one tile high,
+        // a contiguous run of bands to each of _parts parts
+        std::pair<int, int> getBandRows(unsigned _part, unsigned _parts) const
+        {
+            size_t _bands = static_cast<size_t>(tilesY);
+            auto _row = [&](size_t _p) { return static_cast<int>(min(static_cast<size_t>(size[1]), (_bands * _p / _parts) << TILE_SHIFT)); };
+            return { _row(_part), _row(_part + 1) };
+        }
+        // Storage indices holding rows [_first, _last); tiled storage rounds out to whole bands
+        std::pair<size_t, size_t> storageOf(int _first, int _last) const
+        {
+            if (!tiled)
+            {
+                return { static_cast<size_t>(_first) * size[0], static_cast<size_t>(_last) * size[0] };
+            }
+            size_t _band = static_cast<size_t>(tilesX) * TILE_PIXELS;
+            return { (static_cast<size_t>(_first) >> TILE_SHIFT) * _band,
+                     ((static_cast<size_t>(_last) + TILE_SIZE - 1) >> TILE_SHIFT) * _band };
+        }
+    };
+
+    // Per-pixel depth, greater is nearer, cleared to -1. Over a tiled PixelLayout every tile is
+    // also compressed: it stays CLEARED, or holds one PLANE with its min/max, until something
+    // writes single pixels into it, and only then is it EXPANDED to per-pixel values.
+    // Indexing expands a tile on demand, so per-pixel code works on either kind of buffer.
+    // With _owners its rows are placed like those of a SequenceMap with the same owners.
+    class DepthBuffer : public std::vector<Float, FirstTouchAllocator<Float>>
     {
     public:
-        template <typename... _Args>
-        DepthBuffer(_Args&&... _args) : std::vector<Float>(_args...) {}
+        enum class TileState : uint8_t
+        {
+            CLEARED, PLANE, EXPANDED
+        };
+        // z is the depth at the tile's top-left pixel. For an EXPANDED tile only zmin is kept,
+        // as a lower bound: tested depth writes only ever raise values, and writers that skip
+        // the test bring it down with lowerTileMin().
+        struct TilePlane
+        {
+            Float z = -1, dzdx = 0, dzdy = 0;
+            Float zmin = -1, zmax = -1;
+        };
+
+    protected:
+        PixelLayout _layout;
+        std::vector<TileState> _states;
+        std::vector<TilePlane> _planes;
+
+    public:
+        DepthBuffer(const PixelLayout& _layout = {}, JobSystem* _owners = nullptr) :
+            std::vector<Float, FirstTouchAllocator<Float>>(_layout.storageSize()), _layout(_layout),
+            _states(_layout.tiled ? static_cast<size_t>(_layout.tilesX) * _layout.tilesY : 0, TileState::CLEARED),
+            _planes(_states.size())
+        {
+            if (_owners)
+            {
+                unsigned _workers = max(1u, _owners->getThreadCount());
+                _owners->forEachWorker([&](unsigned _worker)
+                {
+                    auto [_first, _last] = _layout.getBandRows(_worker, _workers);
+                    auto [_begin, _end] = _layout.storageOf(_first, _last);
+                    std::fill(begin() + _begin, begin() + _end, Float(-1));
+                });
+            }
+            else
+            {
+                std::fill(begin(), end(), Float(-1));
+            }
+        }
+
+        // Compressed buffers clear in O(tiles)
         void clear()
         {
-            std::fill(begin(), end(), -1);
+            if (isCompressed())
+            {
+                std::fill(_states.begin(), _states.end(), TileState::CLEARED);
+            }
+            else
+            {
+                std::fill(begin(), end(), -1);
+            }
+        }
+
+        inline Float& operator[](size_t _index)
+        {
+            if (isCompressed() && _states[_index >> (2 * PixelLayout::TILE_SHIFT)] != TileState::EXPANDED)
+            {
+                expand(_index >> (2 * PixelLayout::TILE_SHIFT));
+            }
+            return data()[_index];
+        }
+        inline Float operator[](size_t _index) const
+        {
+            if (!isCompressed())
+            {
+                return data()[_index];
+            }
+            size_t _tile = _index >> (2 * PixelLayout::TILE_SHIFT);
+            switch (_states[_tile])
+            {
+            case TileState::CLEARED: return -1;
+            case TileState::PLANE:
+            {
+                uint32_t _morton = static_cast<uint32_t>(_index & (PixelLayout::TILE_PIXELS - 1));
+                auto& _p = _planes[_tile];
+                return _p.z + _p.dzdx * _compact(_morton) + _p.dzdy * _compact(_morton >> 1);
+            }
+            default: return data()[_index];
+            }
+        }
+
+        inline bool isCompressed() const
+        {
+            return !_states.empty();
+        }
+        inline const PixelLayout& getLayout() const
+        {
+            return _layout;
+        }
+        inline TileState getTileState(size_t _tile) const
+        {
+            return _states[_tile];
+        }
+        // Lower and upper bounds of the depth stored in a tile
+        inline Float getTileMin(size_t _tile) const
+        {
+            return _states[_tile] == TileState::CLEARED ? -1 : _planes[_tile].zmin;
+        }
+        inline Float getTileMax(size_t _tile) const
+        {
+            switch (_states[_tile])
+            {
+            case TileState::CLEARED: return -1;
+            case TileState::PLANE: return _planes[_tile].zmax;
+            default: return std::numeric_limits<Float>::infinity();
+            }
+        }
+        // After depth below the tile's bound has been written into it, e.g. by DepthTest::ALWAYS
+        inline void lowerTileMin(size_t _tile, Float _z)
+        {
+            _planes[_tile].zmin = min(_planes[_tile].zmin, _z);
+        }
+        // Replaces the whole tile with one plane; the caller guarantees it wins every pixel
+        inline void setTilePlane(size_t _tile, const TilePlane& _plane)
+        {
+            _states[_tile] = TileState::PLANE;
+            _planes[_tile] = _plane;
+        }
+
+        void expand(size_t _tile)
+        {
+            Float* _pixels = data() + (_tile << (2 * PixelLayout::TILE_SHIFT));
+            auto& _p = _planes[_tile];
+            if (_states[_tile] == TileState::CLEARED)
+            {
+                std::fill(_pixels, _pixels + PixelLayout::TILE_PIXELS, Float(-1));
+                _p.zmin = -1;
+            }
+            else if (_states[_tile] == TileState::PLANE)
+            {
+                for (uint32_t _m = 0; _m < PixelLayout::TILE_PIXELS; _m++)
+                {
+                    _pixels[_m] = _p.z + _p.dzdx * _compact(_m) + _p.dzdy * _compact(_m >> 1);
+                }
+            }
+            _states[_tile] = TileState::EXPANDED;
+        }
+        // For writers that may touch any tile from several threads
+        void expandAll()
+        {
+            for (size_t _tile = 0; _tile < _states.size(); _tile++)
+            {
+                if (_states[_tile] != TileState::EXPANDED)
+                {
+                    expand(_tile);
+                }
+            }
+        }
+
+    protected:
+        // Inverse of PixelLayout::spread: gathers the even bits of _v
+        inline static constexpr int _compact(uint32_t _v)
+        {
+            return static_cast<int>((_v & 1) | ((_v >> 1) & 2) | ((_v >> 2) & 4));
         }
     };
 };
@@ -0,0 +1,360 @@
+#pragma once
+#include "drawing_utility.hpp"
+
+namespace lightroom
+{
+    // One world-space segment of a batch; batches are plain contiguous arrays of these
+    struct LineSegment3D
+    {
+        float from[3];
+        float to[3];
+        COLORREF color;
+    };
+
+    class LineBatchRenderer
+    {
+    private:
+        struct alignas(32) ScreenSegment
+        {
+            float x0, y0, z0;
+            float x1, y1, z1;
+            COLORREF color;
+            int steps;
+        };
+
+        int _tileSize;
+        JobSystem& _jobs;
+        unsigned _threadCount;
+
+        std::vector<ScreenSegment> _screen;
+        std::vector<uint32_t> _binCounts;
+        std::vector<uint32_t> _binOffsets;
+        std::vector<uint32_t> _binned;
+
+        size_t _lastSegmentCount = 0;
+        double _lastSeconds = 0;
+
+    public:
+        // _threadCount 0 uses every worker of _jobs plus the calling thread
+        inline LineBatchRenderer(int _tileSize = 64, unsigned _threadCount = 0,
+                                 JobSystem& _jobs = JobSystem::getDefault()) :
+            _tileSize(_tileSize), _jobs(_jobs),
+            _threadCount(_threadCount ? _threadCount : _jobs.getThreadCount() + 1) {}
+
+        // Transforms, bins and rasterizes _count segments.
+        // _toClip is the model-view-projection, _toScreen the viewport transform applied after division.
+        // _nearPlane, if given, is the clip-space plane (a, b, c, d) segments are cut against before
+        // the division: only the part where a*x + b*y + c*z + d*w >= 0 is drawn.
+        inline void render(const LineSegment3D* _segments, size_t _count,
+                           const TransformMixer3D& _toClip, const TransformMixer3D& _toScreen,
+                           WritableColorMap* _out, DepthBuffer* _depthBuffer = nullptr,
+                           const float* _nearPlane = nullptr)
+        {
+            auto _start = std::chrono::high_resolution_clock::now();
+
+            int _width = _out->getWidth();
+            int _height = _out->getHeight();
+            int _tilesX = (_width + _tileSize - 1) / _tileSize;
+            int _tilesY = (_height + _tileSize - 1) / _tileSize;
+            size_t _tileCount = static_cast<size_t>(_tilesX) * _tilesY;
+
+            _screen.resize(_count);
+            _binCounts.assign(_tileCount * _threadCount, 0);
+            _binOffsets.resize(_tileCount * _threadCount + 1);
+
+            size_t _chunk = (_count + _threadCount - 1) / _threadCount;
+
+            // transform and count bins, one contiguous chunk per thread so the binned order stays the input order
+            _parallel([&](unsigned _thread)
+                      {
+                          size_t _begin = min(_count, _thread * _chunk);
+                          size_t _end = min(_count, _begin + _chunk);
+                          _transform(_segments, _begin, _end, _toClip, _toScreen, _nearPlane);
+                          _forEachTile(_begin, _end, _width, _height, _tilesX,
+                                       [&](uint32_t, size_t _tile)
+                                       {
+                                           _binCounts[_tile * _threadCount + _thread]++;
+                                       });
+                      });
+
+            _binOffsets[0] = 0;
+            for (size_t _i = 0; _i < _binCounts.size(); _i++)
+            {
+                _binOffsets[_i + 1] = _binOffsets[_i] + _binCounts[_i];
+            }
+            _binned.resize(_binOffsets.back());
+
+            _parallel([&](unsigned _thread)
+                      {
+                          size_t _begin = min(_count, _thread * _chunk);
+                          size_t _end = min(_count, _begin + _chunk);
+                          std::vector<uint32_t> _cursor(_tileCount);
+                          for (size_t _tile = 0; _tile < _tileCount; _tile++)
+                          {
+                              _cursor[_tile] = _binOffsets[_tile * _threadCount + _thread];
+                          }
+                          _forEachTile(_begin, _end, _width, _height, _tilesX,
+                                       [&](uint32_t _segment, size_t _tile)
+                                       {
+                                           _binned[_cursor[_tile]++] = _segment;
+                                       });
+                      });
+
+            // tiles are disjoint, so workers never touch the same pixel; compressed depth is
+            // expanded up front so that no two workers expand one depth tile
+            if (_depthBuffer)
+            {
+                _depthBuffer->expandAll();
+            }
+            auto _rasterizeTile = [&](size_t _tile)
+            {
+                int _tx = static_cast<int>(_tile % _tilesX) * _tileSize;
+                int _ty = static_cast<int>(_tile / _tilesX) * _tileSize;
+                int _rect[4]{ _tx, _ty,
+                    min(_tx + _tileSize, _width) - 1, min(_ty + _tileSize, _height) - 1 };
+
+                auto _first = _binOffsets[_tile * _threadCount];
+                auto _last = _binOffsets[(_tile + 1) * _threadCount];
+                for (auto _i = _first; _i < _last; _i++)
+                {
+                    _rasterize(_screen[_binned[_i]], _rect, _out, _depthBuffer);
+                }
+            };
+            // an output placed with this job system's workers is drawn by the owner of each
+            // tile's top row, so most writes land on that worker's node
+            auto _placed = dynamic_cast<SequenceMap*>(_out);
+            if (_placed && _placed->getOwners() == &_jobs)
+            {
+                _jobs.forEachWorker([&](unsigned _worker)
+                {
+                    // tile rows whose top row lies in the worker's rows
+                    auto [_first, _last] = _placed->getOwnedRows(_worker);
+                    size_t _rowBegin = (static_cast<size_t>(_first) + _tileSize - 1) / _tileSize;
+                    size_t _rowEnd = (static_cast<size_t>(_last) + _tileSize - 1) / _tileSize;
+                    for (size_t _tile = _rowBegin * _tilesX; _tile < _rowEnd * _tilesX; _tile++)
+                    {
+                        _rasterizeTile(_tile);
+                    }
+                });
+            }
+            else
+            {
+                std::atomic<size_t> _nextTile = 0;
+                _parallel([&](unsigned)
+                          {
+                              for (size_t _tile; (_tile = _nextTile++) < _tileCount;)
+                              {
+                                  _rasterizeTile(_tile);
+                              }
+                          });
+            }
+
+            _lastSegmentCount = _count;
+            _lastSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - _start).count();
+        }
+
+        inline size_t getLastSegmentCount() const
+        {
+            return _lastSegmentCount;
+        }
+        inline double getLastSeconds() const
+        {
+            return _lastSeconds;
+        }
+        inline double getSegmentsPerSecond() const
+        {
+            return _lastSeconds > 0 ? _lastSegmentCount / _lastSeconds : 0;
+        }
+
+    private:
+        // Runs _func(i) once for every slot i in [0, _threadCount) on the job system
+        template <typename _Func>
+        inline void _parallel(_Func&& _func) const
+        {
+            _jobs.parallelFor(_threadCount, [&](size_t _slot)
+                              {
+                                  _func(static_cast<unsigned>(_slot));
+                              });
+        }
+
+        inline static float _dot4(const float* _a, const float* _b)
+        {
+            return _a[0] * _b[0] + _a[1] * _b[1] + _a[2] * _b[2] + _a[3] * _b[3];
+        }
+
+        inline void _transform(const LineSegment3D* _segments, size_t _begin, size_t _end,
+                               const TransformMixer3D& _toClip, const TransformMixer3D& _toScreen,
+                               const float* _nearPlane)
+        {
+            Matrix<4> _c = _toClip.matrix();
+            Matrix<4> _s = _toScreen.matrix();
+            __m128 _cc[4], _sc[4];
+            for (int _j = 0; _j < 4; _j++)
+            {
+                _cc[_j] = _mm_setr_ps(float(_c(0, _j)), float(_c(1, _j)), float(_c(2, _j)), float(_c(3, _j)));
+                _sc[_j] = _mm_setr_ps(float(_s(0, _j)), float(_s(1, _j)), float(_s(2, _j)), float(_s(3, _j)));
+            }
+            auto _toClipSpace = [&](const float* _p)
+            {
+                return _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_cc[0], _mm_set1_ps(_p[0])), _mm_mul_ps(_cc[1], _mm_set1_ps(_p[1]))),
+                    _mm_add_ps(_mm_mul_ps(_cc[2], _mm_set1_ps(_p[2])), _cc[3]));
+            };
+            auto _toScreenSpace = [&](__m128 _clip)
+            {
+                alignas(16) float _h[4];
+                _mm_store_ps(_h, _clip);
+                __m128 _ndc = _h[3] != 0 ? _mm_div_ps(_clip, _mm_set1_ps(_h[3])) : _clip;
+                _mm_store_ps(_h, _ndc);
+                return _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(_sc[0], _mm_set1_ps(_h[0])), _mm_mul_ps(_sc[1], _mm_set1_ps(_h[1]))),
+                    _mm_add_ps(_mm_mul_ps(_sc[2], _mm_set1_ps(_h[2])), _sc[3]));
+            };
+            for (size_t _i = _begin; _i < _end; _i++)
+            {
+                __m128 _clipA = _toClipSpace(_segments[_i].from), _clipB = _toClipSpace(_segments[_i].to);
+                alignas(16) float _hA[4], _hB[4];
+                _mm_store_ps(_hA, _clipA);
+                _mm_store_ps(_hB, _clipB);
+                // cut at the near plane before the divide, which would mirror points behind the
+                // camera onto the screen
+                float _dA = _nearPlane ? _dot4(_nearPlane, _hA) : 0, _dB = _nearPlane ? _dot4(_nearPlane, _hB) : 0;
+                if (!(_dA >= 0 || _dB >= 0))
+                {
+                    _screen[_i].steps = -1;
+                    continue;
+                }
+                if (_dA < 0 || _dB < 0)
+                {
+                    __m128 _onPlane = _mm_add_ps(_clipA, _mm_mul_ps(_mm_sub_ps(_clipB, _clipA), _mm_set1_ps(_dA / (_dA - _dB))));
+                    (_dA < 0 ? _clipA : _clipB) = _onPlane;
+                }
+                alignas(16) float _a[4], _b[4];
+                _mm_store_ps(_a, _toScreenSpace(_clipA));
+                _mm_store_ps(_b, _toScreenSpace(_clipB));
+
+                auto& _out = _screen[_i];
+                _out = { _a[0], _a[1], _a[2], _b[0], _b[1], _b[2], _segments[_i].color, 0 };
+                float _major = max(std::abs(_b[0] - _a[0]), std::abs(_b[1] - _a[1]));
+                // a NaN or huge extent means the segment is degenerate after projection
+                _out.steps = (_major >= 0 && _major < (1 << 24)) ? static_cast<int>(std::ceil(_major)) : -1;
+            }
+        }
+
+        template <typename _Func>
+        inline void _forEachTile(size_t _begin, size_t _end, int _width, int _height, int _tilesX,
+                                 _Func&& _func) const
+        {
+            for (size_t _i = _begin; _i < _end; _i++)
+            {
+                auto& _s = _screen[_i];
+                if (_s.steps < 0)
+                {
+                    continue;
+                }
+                float _xMin = min(_s.x0, _s.x1), _xMax = max(_s.x0, _s.x1);
+                float _yMin = min(_s.y0, _s.y1), _yMax = max(_s.y0, _s.y1);
+                if (_xMax < -0.5f || _yMax < -0.5f || _xMin > _width - 0.5f || _yMin > _height - 0.5f)
+                {
+                    continue;
+                }
+                int _txMin = max(0, static_cast<int>(_xMin + 0.5f)) / _tileSize;
+                int _txMax = min(_width - 1, static_cast<int>(_xMax + 0.5f)) / _tileSize;
+                int _tyMin = max(0, static_cast<int>(_yMin + 0.5f)) / _tileSize;
+                int _tyMax = min(_height - 1, static_cast<int>(_yMax + 0.5f)) / _tileSize;
+                for (int _ty = _tyMin; _ty <= _tyMax; _ty++)
+                {
+                    for (int _tx = _txMin; _tx <= _txMax; _tx++)
+                    {
+                        _func(static_cast<uint32_t>(_i), static_cast<size_t>(_ty) * _tilesX + _tx);
+                    }
+                }
+            }
+        }
+
+        // DDA along the major axis, four steps per iteration; the only per-pixel branch is the lane mask
+        inline static void _rasterize(const ScreenSegment& _s, const int (&_rect)[4],
+                                      WritableColorMap* _out, DepthBuffer* _depthBuffer)
+        {
+            int _n = _s.steps;
+            float _inv = _n > 0 ? 1.0f / _n : 0.0f;
+            float _sx = (_s.x1 - _s.x0) * _inv;
+            float _sy = (_s.y1 - _s.y0) * _inv;
+            float _sz = (_s.z1 - _s.z0) * _inv;
+
+            // clip the step range against the tile so long segments skip straight to their visible part
+            float _tMin = 0, _tMax = static_cast<float>(_n);
+            auto _clip = [&](float _p, float _d, float _lo, float _hi)
+            {
+                if (_d == 0)
+                {
+                    if (_p < _lo || _p > _hi)
+                    {
+                        _tMax = -1;
+                    }
+                    return;
+                }
+                float _t0 = (_lo - _p) / _d, _t1 = (_hi - _p) / _d;
+                if (_t0 > _t1)
+                {
+                    std::swap(_t0, _t1);
+                }
+                _tMin = max(_tMin, _t0);
+                _tMax = min(_tMax, _t1);
+            };
+            _clip(_s.x0, _sx, _rect[0] - 0.5f, _rect[2] + 0.5f);
+            _clip(_s.y0, _sy, _rect[1] - 0.5f, _rect[3] + 0.5f);
+            if (_tMin > _tMax)
+            {
+                return;
+            }
+            int _iBegin = max(0, static_cast<int>(std::floor(_tMin)));
+            int _iEnd = min(_n, static_cast<int>(std::ceil(_tMax)));
+
+            Color _color(_s.color);
+
+            const __m128 _lane = _mm_setr_ps(0, 1, 2, 3);
+            const __m128i _xLo = _mm_set1_epi32(_rect[0] - 1), _xHi = _mm_set1_epi32(_rect[2] + 1);
+            const __m128i _yLo = _mm_set1_epi32(_rect[1] - 1), _yHi = _mm_set1_epi32(_rect[3] + 1);
+            const __m128i _last = _mm_set1_epi32(_iEnd + 1);
+            for (int _i = _iBegin; _i <= _iEnd; _i += 4)
+            {
+                __m128 _t = _mm_add_ps(_mm_set1_ps(static_cast<float>(_i)), _lane);
+                __m128i _x = _mm_cvtps_epi32(_mm_add_ps(_mm_set1_ps(_s.x0), _mm_mul_ps(_t, _mm_set1_ps(_sx))));
+                __m128i _y = _mm_cvtps_epi32(_mm_add_ps(_mm_set1_ps(_s.y0), _mm_mul_ps(_t, _mm_set1_ps(_sy))));
+                __m128i _inside = _mm_and_si128(
+                    _mm_and_si128(_mm_cmpgt_epi32(_x, _xLo), _mm_cmplt_epi32(_x, _xHi)),
+                    _mm_and_si128(_mm_cmpgt_epi32(_y, _yLo), _mm_cmplt_epi32(_y, _yHi)));
+                _inside = _mm_and_si128(_inside,
+                                        _mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32(_i), _mm_setr_epi32(0, 1, 2, 3)), _last));
+                int _bits = _mm_movemask_ps(_mm_castsi128_ps(_inside));
+                if (!_bits)
+                {
+                    continue;
+                }
+
+                alignas(16) int _xs[4], _ys[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(_xs), _x);
+                _mm_store_si128(reinterpret_cast<__m128i*>(_ys), _y);
+                for (int _l = 0; _l < 4; _l++)
+                {
+                    if (!(_bits & (1 << _l)))
+                    {
+                        continue;
+                    }
+                    size_t _index = _out->indexOf(_xs[_l], _ys[_l]);
+                    if (_depthBuffer)
+                    {
+                        Float _depth = _s.z0 + (_i + _l) * _sz;
+                        if (_depth <= (*_depthBuffer)[_index])
+                        {
+                            continue;
+                        }
+                        (*_depthBuffer)[_index] = _depth;
+                    }
+                    _out->set(_index, _color);
+                }
+            }
+        }
+    };
+};
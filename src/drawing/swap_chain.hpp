@@ -0,0 +1,148 @@
+#pragma once
+#include "drawing_utility.hpp"
+
+namespace lightroom
+{
+    // Two or three colour targets handed round between the renderer and a present thread.
+    // The renderer draws into getBackBuffer() and calls present(); the present thread hands the
+    // frame to the presenter, wipes it and gives it back. Buffers go round in submission order,
+    // and the handoff is a pair of counters, so neither side takes a lock.
+    class SwapChain
+    {
+    public:
+        using Presenter = std::function<void(const SequenceMap& _frame)>;
+
+    protected:
+        // set in _submitted by stop(), so the present thread's wait always sees the change
+        static constexpr uint64_t STOP = uint64_t(1) << 63;
+
+        std::vector<std::unique_ptr<SequenceMap>> _buffers;
+        std::atomic<uint64_t> _submitted = 0;   // frames the renderer has finished drawing, plus STOP
+        std::atomic<uint64_t> _released = 0;    // frames presented and wiped, free to draw into again
+        std::thread _thread;
+        Presenter _presenter;
+
+    public:
+        // _owners places every buffer's rows with the workers that draw them, as for SequenceMap
+        SwapChain(const PxCoordinate& _size, unsigned _bufferCount = 2, ColorMap* _background = nullptr,
+                  bool _tiled = false, JobSystem* _owners = nullptr)
+        {
+            for (unsigned _i = 0; _i < max(2u, _bufferCount); _i++)
+            {
+                _buffers.push_back(std::make_unique<SequenceMap>(_size, _background, _tiled, _owners));
+            }
+        }
+        ~SwapChain()
+        {
+            stop();
+        }
+        SwapChain(const SwapChain&) = delete;
+        SwapChain& operator=(const SwapChain&) = delete;
+
+        // Starts the present thread; frames submitted before this are presented once it runs
+        void start(Presenter _presenter)
+        {
+            stop();
+            this->_presenter = std::move(_presenter);
+            _thread = std::thread([this]() { _run(); });
+        }
+        // Presents every submitted frame, then ends the present thread
+        void stop()
+        {
+            if (!_thread.joinable())
+            {
+                return;
+            }
+            _submitted.fetch_or(STOP, std::memory_order_release);
+            _submitted.notify_one();
+            _thread.join();
+            _submitted.fetch_and(~STOP, std::memory_order_relaxed);
+        }
+
+        // The buffer the next frame is drawn into; waits while it is still being presented
+        SequenceMap* getBackBuffer()
+        {
+            uint64_t _frame = getSubmittedCount();
+            waitBuffer(_frame);
+            return _buffers[_frame % _buffers.size()].get();
+        }
+        // Waits until the buffer of submitted frame number _frame, counting from 0, is free.
+        // Lets a renderer wait ahead of time, off the thread that will call getBackBuffer().
+        void waitBuffer(uint64_t _frame) const
+        {
+            for (uint64_t _released; (_released = this->_released.load(std::memory_order_acquire)) + _buffers.size() <= _frame;)
+            {
+                this->_released.wait(_released, std::memory_order_acquire);
+            }
+        }
+        // Hands the back buffer to the present thread
+        void present()
+        {
+            _submitted.fetch_add(1, std::memory_order_release);
+            _submitted.notify_one();
+        }
+        // Waits until every submitted frame has been presented; the present thread must be running
+        void waitIdle() const
+        {
+            uint64_t _frame = _submitted.load(std::memory_order_relaxed) & ~STOP;
+            for (uint64_t _released; (_released = this->_released.load(std::memory_order_acquire)) < _frame;)
+            {
+                this->_released.wait(_released, std::memory_order_acquire);
+            }
+        }
+
+        inline size_t getBufferCount() const
+        {
+            return _buffers.size();
+        }
+        inline SequenceMap* getBuffer(size_t _index) const
+        {
+            return _buffers[_index].get();
+        }
+        // Frames handed to present() so far
+        inline uint64_t getSubmittedCount() const
+        {
+            return _submitted.load(std::memory_order_relaxed) & ~STOP;
+        }
+        inline uint64_t getPresentedCount() const
+        {
+            return _released.load(std::memory_order_acquire);
+        }
+        // Sets the background of every buffer; only while the present thread is idle
+        void setBackground(ColorMap* _background)
+        {
+            for (auto& _buffer : _buffers)
+            {
+                _buffer->setBackground(_background);
+            }
+        }
+
+    protected:
+        void _run()
+        {
+            uint64_t _frame = _released.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                uint64_t _submitted;
+                while ((_submitted = this->_submitted.load(std::memory_order_acquire)) == _frame)
+                {
+                    this->_submitted.wait(_submitted, std::memory_order_acquire);
+                }
+                bool _stop = _submitted & STOP;
+                for (_submitted &= ~STOP; _frame < _submitted; _frame++)
+                {
+                    auto& _buffer = *_buffers[_frame % _buffers.size()];
+                    _presenter(_buffer);
+                    // cleared here so the renderer never waits on a wipe
+                    _buffer.wipe();
+                    _released.store(_frame + 1, std::memory_order_release);
+                    _released.notify_all();
+                }
+                if (_stop)
+                {
+                    return;
+                }
+            }
+        }
+    };
+};
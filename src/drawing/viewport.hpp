@@ -3,22 +3,48 @@
 
 namespace lightroom
 {
+    // Selects the windowless constructors of Viewport and Pipeline
+    struct Headless {};
+
     class Viewport
     {
     public:
         inline Viewport(WritableColorMap* output, LPRECT lpRect = nullptr, const int _flag = EW_SHOWCONSOLE);
+        // Opens no window and leaves EasyX alone, so any number may exist, on any threads.
+        // The viewport takes output's size and print() resolves into getPixels().
+        inline Viewport(WritableColorMap* output, Headless);
         inline ~Viewport() = default;
         inline Viewport(const Viewport&) = delete;
         inline Viewport& operator=(const Viewport&) = delete;
 
-        inline int getWidth();
-        inline int getHeight();
+        inline int getWidth() const;
+        inline int getHeight() const;
+        inline bool isHeadless() const;
+        // Headless only: the last printed frame, getWidth() * getHeight() pixels as 0x00RRGGBB
+        inline const DWORD* getPixels() const;
 
-        inline void print(IMAGE* _outDevice = NULL) const;
+        // SequenceMap outputs are resolved in row bands on _jobs
+        inline void print(IMAGE* _outDevice = NULL, JobSystem& _jobs = JobSystem::getDefault()) const;
+        // Prints _frame instead of output, e.g. a swap chain's front buffer
+        inline void print(const WritableColorMap& _frame, IMAGE* _outDevice = NULL,
+                          JobSystem& _jobs = JobSystem::getDefault()) const;
+        // As print(), but leaves the window alone, so any thread may call it: the frame is
+        // converted into a staging buffer that the window's thread shows with blit().
+        // Headless viewports resolve straight into getPixels().
+        inline void resolve(const WritableColorMap& _frame, JobSystem& _jobs = JobSystem::getDefault()) const;
+        // Window thread only: shows every resolved frame, oldest first
+        inline void blit() const;
         WritableColorMap* output;
     private:
         int _width;
         int _height;
+        bool _headless = false;
+        mutable std::vector<DWORD> _pixels;
+        mutable std::deque<std::vector<DWORD>> _staged;     // resolved, waiting for blit()
+        mutable std::vector<std::vector<DWORD>> _stagingSpare;
+        mutable std::mutex _stagingMutex;
+
+        inline void _resolve(const WritableColorMap& _frame, DWORD* _imgBuffer, JobSystem& _jobs) const;
     };
 
     Viewport::Viewport(WritableColorMap* output, LPRECT lpRect, const int _flag) :
@@ -67,21 +93,165 @@ namespace lightroom
             lpRect->bottom = top + _height;
         }
     }
-    int Viewport::getWidth()
+    Viewport::Viewport(WritableColorMap* output, Headless) :
+        output(output), _width(output->getWidth()), _height(output->getHeight()), _headless(true),
+        _pixels(static_cast<size_t>(_width) * _height) {}
+    int Viewport::getWidth() const
     {
         return _width;
     }
-    int Viewport::getHeight()
+    int Viewport::getHeight() const
     {
         return _height;
     }
-    void Viewport::print(IMAGE* _outDevice) const
+    bool Viewport::isHeadless() const
+    {
+        return _headless;
+    }
+    const DWORD* Viewport::getPixels() const
+    {
+        return _pixels.data();
+    }
+    void Viewport::print(IMAGE* _outDevice, JobSystem& _jobs) const
+    {
+        print(*output, _outDevice, _jobs);
+    }
+    void Viewport::print(const WritableColorMap& _frame, IMAGE* _outDevice, JobSystem& _jobs) const
+    {
+        _resolve(_frame, _headless && !_outDevice ? _pixels.data() : GetImageBuffer(_outDevice), _jobs);
+        if (!_headless)
+        {
+            FlushBatchDraw();
+        }
+    }
+    void Viewport::resolve(const WritableColorMap& _frame, JobSystem& _jobs) const
     {
-        auto _imgBuffer = GetImageBuffer(_outDevice);
-        for (size_t _i = 0; _i < static_cast<size_t>(_width) * _height; _i++)
+        if (_headless)
         {
-            _imgBuffer[_i] = output->get(_i).toRGBColor();
+            _resolve(_frame, _pixels.data(), _jobs);
+            return;
+        }
+        std::vector<DWORD> _buffer;
+        {
+            std::lock_guard<std::mutex> _lock(_stagingMutex);
+            if (!_stagingSpare.empty())
+            {
+                _buffer = std::move(_stagingSpare.back());
+                _stagingSpare.pop_back();
+            }
+        }
+        _buffer.resize(static_cast<size_t>(_width) * _height);
+        _resolve(_frame, _buffer.data(), _jobs);
+        std::lock_guard<std::mutex> _lock(_stagingMutex);
+        _staged.push_back(std::move(_buffer));
+    }
+    void Viewport::blit() const
+    {
+        if (_headless)
+        {
+            return;
+        }
+        for (;;)
+        {
+            std::vector<DWORD> _buffer;
+            {
+                std::lock_guard<std::mutex> _lock(_stagingMutex);
+                if (_staged.empty())
+                {
+                    return;
+                }
+                _buffer = std::move(_staged.front());
+                _staged.pop_front();
+            }
+            std::copy(_buffer.begin(), _buffer.end(), GetImageBuffer(NULL));
+            FlushBatchDraw();
+            std::lock_guard<std::mutex> _lock(_stagingMutex);
+            _stagingSpare.push_back(std::move(_buffer));
+        }
+    }
+    void Viewport::_resolve(const WritableColorMap& _frame, DWORD* _imgBuffer, JobSystem& _jobs) const
+    {
+        // a SequenceMap is already composited, so it is read straight from its buffer
+        auto _sequence = dynamic_cast<const SequenceMap*>(&_frame);
+        auto& _layout = _frame.getLayout();
+        // rows placed with _jobs' workers are resolved by their owners, from memory on their node
+        bool _owned = _sequence && _sequence->getOwners() == &_jobs;
+        if (_sequence && _layout.tiled)
+        {
+            // de-tiled here, a row of tiles per job, so raster work never sees the linear layout
+            auto _data = _sequence->data();
+            int _w = min(_width, _layout.size[0]), _h = min(_height, _layout.size[1]);
+            size_t _tileRows = (_h + PixelLayout::TILE_SIZE - 1) / PixelLayout::TILE_SIZE;
+            auto _resolveTileRow = [&](size_t _tileRow)
+            {
+                int _ty = static_cast<int>(_tileRow);
+                COLORREF _tile[PixelLayout::TILE_PIXELS];
+                for (int _tx = 0; _tx * PixelLayout::TILE_SIZE < _w; _tx++)
+                {
+                    // packed whole, then scattered, so the conversion runs on contiguous colours
+                    Color::pack(_data + (static_cast<size_t>(_ty) * _layout.tilesX + _tx) * PixelLayout::TILE_PIXELS,
+                                _tile, PixelLayout::TILE_PIXELS);
+                    int _x0 = _tx * PixelLayout::TILE_SIZE, _y0 = _ty * PixelLayout::TILE_SIZE;
+                    int _xn = min(PixelLayout::TILE_SIZE, _w - _x0), _yn = min(PixelLayout::TILE_SIZE, _h - _y0);
+                    for (int _y = 0; _y < _yn; _y++)
+                    {
+                        auto _row = _imgBuffer + static_cast<size_t>(_y0 + _y) * _width + _x0;
+                        uint32_t _my = PixelLayout::spread(_y) << 1;
+                        for (int _x = 0; _x < _xn; _x++)
+                        {
+                            _row[_x] = _tile[PixelLayout::spread(_x) | _my];
+                        }
+                    }
+                }
+            };
+            if (_owned)
+            {
+                _jobs.forEachWorker([&](unsigned _worker)
+                {
+                    auto [_first, _last] = _sequence->getOwnedRows(_worker);
+                    for (int _y = _first; _y < min(_last, _h); _y += PixelLayout::TILE_SIZE)
+                    {
+                        _resolveTileRow(static_cast<size_t>(_y) >> PixelLayout::TILE_SHIFT);
+                    }
+                });
+            }
+            else
+            {
+                _jobs.parallelFor(_tileRows, _resolveTileRow);
+            }
+        }
+        else if (_sequence)
+        {
+            auto _data = _sequence->data();
+            auto _resolveRow = [&](size_t _y)
+            {
+                Color::pack(_data + _y * _width, _imgBuffer + _y * _width, _width);
+            };
+            if (_owned)
+            {
+                _jobs.forEachWorker([&](unsigned _worker)
+                {
+                    auto [_first, _last] = _sequence->getOwnedRows(_worker);
+                    for (int _y = _first; _y < min(_last, _height); _y++)
+                    {
+                        _resolveRow(static_cast<size_t>(_y));
+                    }
+                });
+            }
+            else
+            {
+                _jobs.parallelFor(static_cast<size_t>(_height), _resolveRow, 8);
+            }
+        }
+        else
+        {
+            for (int _y = 0; _y < _height; _y++)
+            {
+                for (int _x = 0; _x < _width; _x++)
+                {
+                    _imgBuffer[static_cast<size_t>(_y) * _width + _x] = _frame.get(_frame.indexOf(_x, _y)).toRGBColor();
+                }
+            }
         }
-        FlushBatchDraw();
     }
 }
\ No newline at end of file
@@ -2,5 +2,6 @@
 
 #include "lrmath.hpp"
 #include "drawing.hpp"
+#include "texture.hpp"
 #include "pipeline.hpp"
 
@@ -74,6 +74,11 @@ namespace lightroom
         return *this;
     }
 
+    inline lightroom::Matrix<4> TransformMixer3D::matrix() const
+    {
+        return *this;
+    }
+
     inline lightroom::Matrix<4> TransformMixer3D::_createScaleMatrix(Float _factorX, Float _factorY, Float _factorZ) const
     {
         lightroom::Matrix<4> _ret;
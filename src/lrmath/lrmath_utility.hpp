@@ -45,6 +45,9 @@ namespace lightroom
         inline TransformMixer3D& apply(const lightroom::Matrix<4>& _matrix)&;
         inline TransformMixer3D apply(const lightroom::Matrix<4>& _matrix)&&;
 
+        // Combined transform matrix
+        inline lightroom::Matrix<4> matrix() const;
+
     private:
         inline lightroom::Matrix<4> _createScaleMatrix(Float, Float, Float) const;
         inline lightroom::Matrix<4> _createRotateMatrix(Angle, Angle, Angle) const;
@@ -35,6 +35,11 @@
 #include <memory>
 #endif // !_memory_
 
+#ifndef _stdexcept_
+#define _stdexcept_
+#include <stdexcept>
+#endif // !_stdexcept_
+
 #ifndef _stack_
 #define _stack_
 #include <stack>
@@ -65,6 +70,96 @@
 #include <unordered_map>
 #endif // !_unordered_map_
 
+#ifndef _functional_
+#define _functional_
+#include <functional>
+#endif // !_functional_
+
+#ifndef _condition_variable_
+#define _condition_variable_
+#include <condition_variable>
+#endif // !_condition_variable_
+
+#ifndef _deque_
+#define _deque_
+#include <deque>
+#endif // !_deque_
+
+#ifndef _queue_
+#define _queue_
+#include <queue>
+#endif // !_queue_
+
+#ifndef _thread_
+#define _thread_
+#include <thread>
+#endif // !_thread_
+
+#ifndef _atomic_
+#define _atomic_
+#include <atomic>
+#endif // !_atomic_
+
+#ifndef _future_
+#define _future_
+#include <future>
+#endif // !_future_
+
+#ifndef _optional_
+#define _optional_
+#include <optional>
+#endif // !_optional_
+
+#ifndef _chrono_
+#define _chrono_
+#include <chrono>
+#endif // !_chrono_
+
+#ifndef _fstream_
+#define _fstream_
+#include <fstream>
+#endif // !_fstream_
+
+#ifndef _sstream_
+#define _sstream_
+#include <sstream>
+#endif // !_sstream_
+
+#ifndef _climits_
+#define _climits_
+#include <climits>
+#endif // !_climits_
+
+#ifndef _limits_
+#define _limits_
+#include <limits>
+#endif // !_limits_
+
+#ifndef _filesystem_
+#define _filesystem_
+#include <filesystem>
+#endif // !_filesystem_
+
+#ifndef _immintrin_H_
+#define _immintrin_H_
+#include <immintrin.h>
+#endif // !_immintrin_H_
+
+#ifndef _cpuid_H_
+#define _cpuid_H_
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif // !_cpuid_H_
+
+#ifndef _psapi_H_
+#define _psapi_H_
+#include <psapi.h>
+#pragma comment(lib, "Psapi.lib")
+#endif // !_psapi_H_
+
 #ifndef _ShellScalingApi_H_
 #define _ShellScalingApi_H_
 #include <ShellScalingApi.h>
@@ -91,4 +186,9 @@ namespace lightroom
     }
 }
 
+#include "lrutility/cpu_features.hpp"
+#include "lrutility/numa.hpp"
+#include "lrutility/job_system.hpp"
+#include "lrutility/radix_sort.hpp"
+
 #endif _LRUTILITY_
\ No newline at end of file
@@ -0,0 +1,149 @@
+#pragma once
+#include "../lrutility.hpp"
+
+// Marks a function compiled for an instruction set beyond the build's baseline, so the hot
+// kernels can carry SSE4.2, AVX2 and AVX-512 variants in one binary. MSVC accepts any
+// intrinsic without /arch, so the attribute is only needed elsewhere. A variant may only be
+// called once CpuFeatures::getIsa() has reported its level.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define LIGHTROOM_TARGET(_isa)
+#else
+#define LIGHTROOM_TARGET(_isa) __attribute__((target(_isa)))
+#endif
+
+namespace lightroom
+{
+    // Kernel variants, each level including the ones below it
+    enum class IsaLevel
+    {
+        SCALAR,
+        SSE42,
+        AVX2,
+        AVX512
+    };
+
+    class CpuFeatures
+    {
+    public:
+        // Highest level both the processor and the operating system support
+        static IsaLevel detect()
+        {
+            unsigned _leaf1[4], _leaf7[4] = {};
+            _cpuid(0, 0, _leaf1);
+            unsigned _maxLeaf = _leaf1[0];
+            _cpuid(1, 0, _leaf1);
+            if (_maxLeaf >= 7)
+            {
+                _cpuid(7, 0, _leaf7);
+            }
+            bool _sse42 = _leaf1[2] & (1u << 20);
+            bool _osxsave = _leaf1[2] & (1u << 27);
+            bool _avx = _leaf1[2] & (1u << 28);
+            bool _avx2 = _leaf7[1] & (1u << 5);
+            bool _avx512f = _leaf7[1] & (1u << 16);
+            // the instructions are no use unless the OS saves the wider registers on a switch
+            uint64_t _xcr0 = _osxsave ? _readXcr0() : 0;
+            bool _ymm = (_xcr0 & 0x06) == 0x06;
+            bool _zmm = (_xcr0 & 0xe6) == 0xe6;
+
+            if (_avx && _avx2 && _avx512f && _zmm)
+            {
+                return IsaLevel::AVX512;
+            }
+            if (_avx && _avx2 && _ymm)
+            {
+                return IsaLevel::AVX2;
+            }
+            return _sse42 ? IsaLevel::SSE42 : IsaLevel::SCALAR;
+        }
+
+        // The level kernels dispatch on: detect(), lowered by the LIGHTROOM_ISA environment
+        // variable (scalar, sse4.2, avx2 or avx512). A level the machine lacks cannot be forced.
+        // Decided on first use, normally when the first Pipeline is created.
+        static IsaLevel getIsa()
+        {
+            static const IsaLevel _isa = _select();
+            return _isa;
+        }
+
+        static const char* getName(IsaLevel _isa)
+        {
+            switch (_isa)
+            {
+                case IsaLevel::SSE42: return "sse4.2";
+                case IsaLevel::AVX2: return "avx2";
+                case IsaLevel::AVX512: return "avx512";
+                case IsaLevel::SCALAR:
+                default: return "scalar";
+            }
+        }
+        // Accepts the names getName() returns, in any case; false for anything else
+        static bool parse(const char* _name, IsaLevel& _isa)
+        {
+            std::string _lower(_name);
+            for (auto& _c : _lower)
+            {
+                _c = static_cast<char>(std::tolower(static_cast<unsigned char>(_c)));
+            }
+            for (auto _level : { IsaLevel::SCALAR, IsaLevel::SSE42, IsaLevel::AVX2, IsaLevel::AVX512 })
+            {
+                if (_lower == getName(_level))
+                {
+                    _isa = _level;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    protected:
+        static IsaLevel _select()
+        {
+            IsaLevel _isa = detect();
+            std::string _override;
+#ifdef _MSC_VER
+            char* _value = nullptr;
+            if (!_dupenv_s(&_value, nullptr, "LIGHTROOM_ISA") && _value)
+            {
+                _override = _value;
+                free(_value);
+            }
+#else
+            if (auto _value = std::getenv("LIGHTROOM_ISA"))
+            {
+                _override = _value;
+            }
+#endif
+            IsaLevel _forced;
+            if (parse(_override.c_str(), _forced) && _forced < _isa)
+            {
+                _isa = _forced;
+            }
+            return _isa;
+        }
+
+        inline static void _cpuid(unsigned _leaf, unsigned _subleaf, unsigned* _regs)
+        {
+#ifdef _MSC_VER
+            int _out[4];
+            __cpuidex(_out, static_cast<int>(_leaf), static_cast<int>(_subleaf));
+            for (int _i = 0; _i < 4; _i++)
+            {
+                _regs[_i] = static_cast<unsigned>(_out[_i]);
+            }
+#else
+            __cpuid_count(_leaf, _subleaf, _regs[0], _regs[1], _regs[2], _regs[3]);
+#endif
+        }
+        inline static uint64_t _readXcr0()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            unsigned _low, _high;
+            __asm__ volatile("xgetbv" : "=a"(_low), "=d"(_high) : "c"(0));
+            return (static_cast<uint64_t>(_high) << 32) | _low;
+#endif
+        }
+    };
+};
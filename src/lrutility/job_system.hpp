@@ -0,0 +1,520 @@
+#pragma once
+#include "../lrutility.hpp"
+
+namespace lightroom
+{
+    class JobSystem;
+
+    // A unit of work with dependencies; handed out as a shared JobHandle
+    class Job
+    {
+        friend class JobSystem;
+
+    protected:
+        static constexpr size_t ANY_WORKER = SIZE_MAX;
+
+        std::function<void()> _work;
+        size_t _worker = ANY_WORKER;        // the only worker allowed to run the job
+        bool _background = false;           // see JobSystem::submitBackground()
+        std::atomic<int> _blockers = 1;     // unfinished dependencies, plus one until submitted
+        std::atomic<bool> _done = false;
+        std::mutex _mutex;
+        std::vector<std::shared_ptr<Job>> _continuations;
+
+    public:
+        Job(std::function<void()>&& _work) : _work(std::move(_work)) {}
+
+        inline bool isDone() const
+        {
+            return _done.load(std::memory_order_acquire);
+        }
+    };
+    using JobHandle = std::shared_ptr<Job>;
+
+    // Work-stealing thread pool. Every worker owns a deque: it pushes and pops its own jobs at
+    // the back, idle workers steal from the front of the others. Threads that wait on a job
+    // (workers or not) run queued jobs meanwhile, so nested parallelFor and waits never deadlock.
+    // Background jobs sit in a queue of their own that only idle workers take from, so a frame
+    // waiting on its raster never ends up running a texture decode. A worker busy with one does
+    // not hold up the jobs pinned to it either: any other thread may take those meanwhile.
+    class JobSystem
+    {
+    public:
+        struct WorkerStats
+        {
+            size_t jobs;            // jobs run by the worker
+            size_t steals;          // of which taken from another worker's deque
+            double busySeconds;
+            double utilization;     // busy share of the time since the last resetStats()
+        };
+
+    protected:
+        struct Worker
+        {
+            std::deque<JobHandle> deque;
+            std::mutex mutex;
+            std::thread thread;
+            std::atomic<size_t> jobs = 0;
+            std::atomic<size_t> steals = 0;
+            std::atomic<int64_t> busyNanoseconds = 0;
+            std::atomic<size_t> pinned = 0;     // queued jobs only this worker may run
+            std::atomic<bool> inBackground = false; // running a background job: others may run its pinned jobs
+            int processor = -1;     // -1: not pinned to a logical processor
+        };
+
+        inline static thread_local JobSystem* _currentSystem = nullptr;
+        inline static thread_local size_t _currentWorker = 0;
+        inline static thread_local int _nesting = 0;   // jobs running on this thread, for busy time
+
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::atomic<size_t> _queued = 0;
+        std::atomic<size_t> _pinned = 0;    // of which tied to one worker
+        std::atomic<size_t> _nextQueue = 0;
+        std::deque<JobHandle> _background;
+        std::mutex _backgroundMutex;
+        std::atomic<size_t> _backgroundQueued = 0;
+        std::mutex _sleepMutex;
+        std::condition_variable _wake;
+        std::atomic<bool> _stopping = false;
+        std::chrono::steady_clock::time_point _statsStart;
+
+    public:
+        // _threadCount workers (0: one per hardware thread, less the caller's); worker i is
+        // pinned to logical processor _affinity[i % size] when _affinity is not empty
+        JobSystem(unsigned _threadCount = 0, const std::vector<unsigned>& _affinity = {}) :
+            _statsStart(std::chrono::steady_clock::now())
+        {
+            if (!_threadCount)
+            {
+                _threadCount = max(2u, std::thread::hardware_concurrency()) - 1;
+            }
+            for (unsigned _i = 0; _i < _threadCount; _i++)
+            {
+                _workers.push_back(std::make_unique<Worker>());
+            }
+            for (unsigned _i = 0; _i < _threadCount; _i++)
+            {
+                _workers[_i]->thread = std::thread([this, _i]() { _work(_i); });
+                if (!_affinity.empty())
+                {
+                    _workers[_i]->processor = static_cast<int>(_affinity[_i % _affinity.size()]);
+                    _pin(_workers[_i]->thread, _affinity[_i % _affinity.size()]);
+                }
+            }
+        }
+        // Jobs still queued are dropped
+        ~JobSystem()
+        {
+            {
+                std::lock_guard<std::mutex> _lock(_sleepMutex);
+                _stopping = true;
+            }
+            _wake.notify_all();
+            for (auto& _w : _workers)
+            {
+                _w->thread.join();
+            }
+        }
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        // Pool shared by everything that is not handed a pool of its own
+        static JobSystem& getDefault()
+        {
+            static JobSystem _default;
+            return _default;
+        }
+
+        // Pool without workers: submit() runs each job at once on the calling thread and
+        // parallelFor() is a plain loop. Shared by any number of threads; for work that is
+        // already spread one task per worker, such as BatchRenderer's renders.
+        static JobSystem& getSerial()
+        {
+            static JobSystem _serial{ Serial{} };
+            return _serial;
+        }
+
+        // _work runs once every job in _dependencies has finished; null dependencies are ignored
+        JobHandle submit(std::function<void()> _work, std::initializer_list<JobHandle> _dependencies = {})
+        {
+            return submit(std::move(_work), _dependencies.begin(), _dependencies.end());
+        }
+        template <typename _Iterator>
+        JobHandle submit(std::function<void()> _work, _Iterator _first, _Iterator _last)
+        {
+            auto _job = std::make_shared<Job>(std::move(_work));
+            for (; _first != _last; ++_first)
+            {
+                auto& _dependency = *_first;
+                if (!_dependency)
+                {
+                    continue;
+                }
+                std::lock_guard<std::mutex> _lock(_dependency->_mutex);
+                if (!_dependency->isDone())
+                {
+                    _job->_blockers++;
+                    _dependency->_continuations.push_back(_job);
+                }
+            }
+            _release(_job);
+            return _job;
+        }
+
+        // Low-priority work, such as loading: runs only on a worker that has nothing else to do,
+        // and never inside wait(). Long jobs should still return now and then, since a worker
+        // that has taken one is busy with it until it does. Without workers, runs at once.
+        JobHandle submitBackground(std::function<void()> _work)
+        {
+            auto _job = std::make_shared<Job>(std::move(_work));
+            _job->_background = true;
+            _release(_job);
+            return _job;
+        }
+
+        // Runs other jobs until _job has finished; background jobs are left to idle workers
+        void wait(const JobHandle& _job)
+        {
+            while (_job && !_job->isDone())
+            {
+                if (!_runOne())
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        // Calls _body(i) for every i in [0, _count), in chunks of _grain, on the calling thread
+        // and up to _maxThreads - 1 workers (0: all); returns when all calls have returned
+        template <typename _Body>
+        void parallelFor(size_t _count, _Body&& _body, size_t _grain = 1, unsigned _maxThreads = 0)
+        {
+            _grain = max(size_t(1), _grain);
+            size_t _chunks = (_count + _grain - 1) / _grain;
+            if (_chunks <= 1 || _workers.empty())
+            {
+                for (size_t _i = 0; _i < _count; _i++)
+                {
+                    _body(_i);
+                }
+                return;
+            }
+            std::atomic<size_t> _next = 0;
+            auto _run = [&]()
+            {
+                for (size_t _begin; (_begin = _next.fetch_add(_grain)) < _count;)
+                {
+                    for (size_t _i = _begin, _end = min(_count, _begin + _grain); _i < _end; _i++)
+                    {
+                        _body(_i);
+                    }
+                }
+            };
+            std::vector<JobHandle> _helpers;
+            size_t _helperCount = min(_chunks - 1, _workers.size());
+            if (_maxThreads)
+            {
+                _helperCount = min(_helperCount, static_cast<size_t>(_maxThreads - 1));
+            }
+            for (size_t _h = 0; _h < _helperCount; _h++)
+            {
+                _helpers.push_back(submit(_run));
+            }
+            _run();
+            for (auto& _helper : _helpers)
+            {
+                wait(_helper);
+            }
+        }
+
+        // Calls _body(w) once on every worker w, and returns when all calls have returned.
+        // Work that should stay with one worker, such as first-touching the memory that worker
+        // will later read. Best effort: while worker w runs a background job, _body(w) may run
+        // on any other thread, so _body must depend on w alone, never on the thread it runs on.
+        // Without workers, _body(0) runs on the calling thread.
+        template <typename _Body>
+        void forEachWorker(_Body&& _body)
+        {
+            if (_workers.empty())
+            {
+                _body(0u);
+                return;
+            }
+            std::vector<JobHandle> _calls;
+            for (size_t _w = 0; _w < _workers.size(); _w++)
+            {
+                auto _job = std::make_shared<Job>([&_body, _w]() { _body(static_cast<unsigned>(_w)); });
+                _job->_worker = _w;
+                _release(_job);
+                _calls.push_back(std::move(_job));
+            }
+            for (auto& _call : _calls)
+            {
+                wait(_call);
+            }
+        }
+
+        inline unsigned getThreadCount() const
+        {
+            return static_cast<unsigned>(_workers.size());
+        }
+        // Logical processor the worker is pinned to; -1 if it is not
+        inline int getWorkerProcessor(unsigned _worker) const
+        {
+            return _workers[_worker]->processor;
+        }
+        WorkerStats getWorkerStats(unsigned _worker) const
+        {
+            auto& _w = *_workers[_worker];
+            double _busy = _w.busyNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+            double _elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - _statsStart).count();
+            return { _w.jobs.load(std::memory_order_relaxed), _w.steals.load(std::memory_order_relaxed),
+                     _busy, _elapsed > 0 ? _busy / _elapsed : 0 };
+        }
+        void resetStats()
+        {
+            for (auto& _w : _workers)
+            {
+                _w->jobs = 0;
+                _w->steals = 0;
+                _w->busyNanoseconds = 0;
+            }
+            _statsStart = std::chrono::steady_clock::now();
+        }
+
+    protected:
+        struct Serial {};
+        JobSystem(Serial) : _statsStart(std::chrono::steady_clock::now()) {}
+
+        // Drops the submission blocker; the job is queued once nothing else blocks it
+        void _release(const JobHandle& _job)
+        {
+            if (--_job->_blockers > 0)
+            {
+                return;
+            }
+            if (_workers.empty())
+            {
+                _execute(_job);
+                return;
+            }
+            if (_job->_background)
+            {
+                {
+                    std::lock_guard<std::mutex> _lock(_backgroundMutex);
+                    _background.push_back(_job);
+                }
+                _backgroundQueued++;
+                {
+                    std::lock_guard<std::mutex> _lock(_sleepMutex);
+                }
+                _wake.notify_one();
+                return;
+            }
+            // workers keep their own jobs local, other threads spread them round-robin
+            bool _isPinned = _job->_worker != Job::ANY_WORKER;
+            size_t _queue = _isPinned ? _job->_worker :
+                _currentSystem == this ? _currentWorker : _nextQueue++ % _workers.size();
+            if (_isPinned)
+            {
+                _workers[_queue]->pinned++;
+                _pinned++;
+            }
+            _queued++;
+            {
+                std::lock_guard<std::mutex> _lock(_workers[_queue]->mutex);
+                _workers[_queue]->deque.push_back(_job);
+            }
+            {
+                std::lock_guard<std::mutex> _lock(_sleepMutex);
+            }
+            // any woken worker may run a free job, but a pinned one must reach its owner
+            if (_isPinned)
+            {
+                _wake.notify_all();
+            }
+            else
+            {
+                _wake.notify_one();
+            }
+        }
+
+        void _execute(const JobHandle& _job)
+        {
+            _job->_work();
+            _job->_work = nullptr;
+            std::vector<JobHandle> _continuations;
+            {
+                std::lock_guard<std::mutex> _lock(_job->_mutex);
+                _job->_done.store(true, std::memory_order_release);
+                _continuations.swap(_job->_continuations);
+            }
+            for (auto& _next : _continuations)
+            {
+                _release(_next);
+            }
+        }
+
+        // A worker takes from the back of its own deque first; everything else is stolen from
+        // the front, skipping jobs pinned to another worker unless that worker is busy with a
+        // background job
+        JobHandle _take(size_t _self, bool _isWorker, bool& _stolen)
+        {
+            size_t _count = _workers.size();
+            for (size_t _k = 0; _k < _count; _k++)
+            {
+                size_t _victim = (_self + _k) % _count;
+                auto& _w = *_workers[_victim];
+                std::lock_guard<std::mutex> _lock(_w.mutex);
+                if (_w.deque.empty())
+                {
+                    continue;
+                }
+                JobHandle _job;
+                if (_k == 0 && _isWorker)
+                {
+                    _job = std::move(_w.deque.back());
+                    _w.deque.pop_back();
+                }
+                else
+                {
+                    bool _ownerAway = _w.inBackground.load();
+                    auto _free = std::find_if(_w.deque.begin(), _w.deque.end(), [_ownerAway](const JobHandle& _j)
+                    {
+                        return _ownerAway || _j->_worker == Job::ANY_WORKER;
+                    });
+                    if (_free == _w.deque.end())
+                    {
+                        continue;
+                    }
+                    _job = std::move(*_free);
+                    _w.deque.erase(_free);
+                }
+                if (_job->_worker != Job::ANY_WORKER)
+                {
+                    _w.pinned--;
+                    _pinned--;
+                }
+                _queued--;
+                _stolen = _k != 0;
+                return _job;
+            }
+            return nullptr;
+        }
+
+        JobHandle _takeBackground()
+        {
+            std::lock_guard<std::mutex> _lock(_backgroundMutex);
+            if (_background.empty())
+            {
+                return nullptr;
+            }
+            auto _job = std::move(_background.front());
+            _background.pop_front();
+            _backgroundQueued--;
+            return _job;
+        }
+
+        // _idle: the caller is a worker with nothing to wait for, which may take background jobs
+        bool _runOne(bool _idle = false)
+        {
+            if (_workers.empty())
+            {
+                return false;
+            }
+            bool _isWorker = _currentSystem == this;
+            size_t _self = _isWorker ? _currentWorker : _nextQueue.load(std::memory_order_relaxed) % _workers.size();
+            bool _stolen = false;
+            auto _job = _take(_self, _isWorker, _stolen);
+            if (!_job && _idle)
+            {
+                _job = _takeBackground();
+            }
+            if (!_job)
+            {
+                return false;
+            }
+            if (!_isWorker)
+            {
+                _execute(_job);
+                return true;
+            }
+            auto& _w = *_workers[_self];
+            _w.jobs++;
+            _w.steals += _stolen;
+            // a job run while another waits on this thread is already inside its busy time
+            if (_nesting++)
+            {
+                _execute(_job);
+                _nesting--;
+                return true;
+            }
+            // background jobs are only taken here, by an idle worker
+            if (_job->_background)
+            {
+                _setInBackground(_w, true);
+            }
+            auto _start = std::chrono::steady_clock::now();
+            _execute(_job);
+            _nesting--;
+            _w.busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - _start).count();
+            if (_job->_background)
+            {
+                _setInBackground(_w, false);
+            }
+            return true;
+        }
+
+        // Jobs already pinned to a worker entering a background job go to whoever is idle
+        void _setInBackground(Worker& _w, bool _inBackground)
+        {
+            _w.inBackground = _inBackground;
+            if (_inBackground && _w.pinned > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> _lock(_sleepMutex);
+                }
+                _wake.notify_all();
+            }
+        }
+        // Some pinned job is queued to a worker busy with a background job
+        bool _hasStrandedJobs() const
+        {
+            return std::any_of(_workers.begin(), _workers.end(), [](const std::unique_ptr<Worker>& _w)
+            {
+                return _w->inBackground && _w->pinned > 0;
+            });
+        }
+
+        void _work(size_t _index)
+        {
+            _currentSystem = this;
+            _currentWorker = _index;
+            while (!_stopping)
+            {
+                if (_runOne(true))
+                {
+                    continue;
+                }
+                // jobs pinned to other workers are no reason to wake, unless their owner is away
+                auto& _w = *_workers[_index];
+                std::unique_lock<std::mutex> _lock(_sleepMutex);
+                _wake.wait(_lock, [this, &_w]()
+                {
+                    return _stopping || _queued > _pinned || _w.pinned > 0 || _backgroundQueued > 0 ||
+                           _hasStrandedJobs();
+                });
+            }
+        }
+
+        // _processor numbered across processor groups, as NumaTopology numbers them
+        inline static void _pin(std::thread& _thread, unsigned _processor)
+        {
+            GROUP_AFFINITY _affinity = {};
+            _affinity.Group = static_cast<WORD>(_processor / NumaTopology::PROCESSORS_PER_GROUP);
+            _affinity.Mask = KAFFINITY(1) << (_processor % NumaTopology::PROCESSORS_PER_GROUP);
+            SetThreadGroupAffinity(_thread.native_handle(), &_affinity, nullptr);
+        }
+    };
+};
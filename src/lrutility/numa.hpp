@@ -0,0 +1,225 @@
+#pragma once
+#include "../lrutility.hpp"
+
+namespace lightroom
+{
+    // Allocates without writing: value-initialised elements are left as raw memory, so a buffer's
+    // pages land on the NUMA node of whichever thread first writes them rather than the one that
+    // allocated them. Only for trivially copyable types the owner fills before reading.
+    template <typename _T>
+    struct FirstTouchAllocator : std::allocator<_T>
+    {
+        static_assert(std::is_trivially_copyable_v<_T> && std::is_trivially_destructible_v<_T>);
+
+        FirstTouchAllocator() = default;
+        template <typename _U>
+        FirstTouchAllocator(const FirstTouchAllocator<_U>&) {}
+
+        template <typename _U>
+        void construct(_U*) noexcept {}
+        template <typename _U, typename... _Args>
+        void construct(_U* _p, _Args&&... _args)
+        {
+            ::new(static_cast<void*>(_p)) _U(std::forward<_Args>(_args)...);
+        }
+    };
+
+    // NUMA nodes (sockets, usually) and the logical processors on each. A machine the OS reports
+    // no topology for is one node holding every active processor.
+    // Processors are numbered across processor groups, group * PROCESSORS_PER_GROUP + bit, as
+    // JobSystem's affinity list takes them.
+    class NumaTopology
+    {
+    public:
+        static constexpr unsigned PROCESSORS_PER_GROUP = 8 * sizeof(KAFFINITY);
+
+    protected:
+        std::vector<std::vector<unsigned>> _nodes;  // logical processors of each node
+        std::vector<size_t> _nodeOf;                // node of each logical processor
+
+    public:
+        NumaTopology()
+        {
+            _detect();
+            if (std::all_of(_nodes.begin(), _nodes.end(), [](const std::vector<unsigned>& _n) { return _n.empty(); }))
+            {
+                _nodes.assign(1, _getActiveProcessors());
+            }
+            for (size_t _n = 0; _n < _nodes.size(); _n++)
+            {
+                for (auto _p : _nodes[_n])
+                {
+                    if (_p >= _nodeOf.size())
+                    {
+                        _nodeOf.resize(_p + 1, 0);
+                    }
+                    _nodeOf[_p] = _n;
+                }
+            }
+        }
+
+        // Detected once
+        static const NumaTopology& get()
+        {
+            static const NumaTopology _topology;
+            return _topology;
+        }
+
+        inline size_t getNodeCount() const
+        {
+            return _nodes.size();
+        }
+        inline const std::vector<unsigned>& getProcessors(size_t _node) const
+        {
+            return _nodes[_node];
+        }
+        inline size_t getNode(unsigned _processor) const
+        {
+            return _processor < _nodeOf.size() ? _nodeOf[_processor] : 0;
+        }
+
+        // Every logical processor, node by node: as JobSystem's affinity list, consecutive
+        // workers share a node, so workers owning neighbouring rows of a frame share a socket
+        std::vector<unsigned> getAffinity() const
+        {
+            std::vector<unsigned> _affinity;
+            for (auto& _node : _nodes)
+            {
+                _affinity.insert(_affinity.end(), _node.begin(), _node.end());
+            }
+            return _affinity;
+        }
+
+        // Bytes of [_data, _data + _bytes) resident on each node. One extra entry at the end
+        // counts pages not yet touched, or whose node the OS does not report.
+        std::vector<size_t> getResidentBytes(const void* _data, size_t _bytes) const
+        {
+            std::vector<size_t> _resident(_nodes.size() + 1, 0);
+            if (!_bytes)
+            {
+                return _resident;
+            }
+            size_t _pageSize = _getPageSize();
+            uintptr_t _begin = reinterpret_cast<uintptr_t>(_data), _end = _begin + _bytes;
+            uintptr_t _first = _begin & ~(_pageSize - 1);
+            size_t _pageCount = (_end - _first + _pageSize - 1) / _pageSize;
+            std::vector<int> _pageNodes(_pageCount, -1);
+            _queryNodes(_first, _pageSize, _pageNodes);
+            for (size_t _i = 0; _i < _pageCount; _i++)
+            {
+                uintptr_t _page = _first + _i * _pageSize;
+                size_t _inRange = min(_page + _pageSize, _end) - max(_page, _begin);
+                int _node = _pageNodes[_i];
+                _resident[_node >= 0 && static_cast<size_t>(_node) < _nodes.size() ? _node : _nodes.size()] += _inRange;
+            }
+            return _resident;
+        }
+
+    protected:
+        // Windows 11 / Server 2022 and later: all of a node's groups, which may be several.
+        // Looked up at run time, as older systems lack it.
+        using _NodeMasks = BOOL(WINAPI*)(USHORT, PGROUP_AFFINITY, USHORT, PUSHORT);
+
+        void _detect()
+        {
+            ULONG _highest = 0;
+            if (!GetNumaHighestNodeNumber(&_highest))
+            {
+                return;
+            }
+            auto _nodeMasks = reinterpret_cast<_NodeMasks>(
+                GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "GetNumaNodeProcessorMask2"));
+            _nodes.resize(_highest + 1);
+            for (ULONG _n = 0; _n <= _highest; _n++)
+            {
+                auto _node = static_cast<USHORT>(_n);
+                std::vector<GROUP_AFFINITY> _masks;
+                if (_nodeMasks)
+                {
+                    USHORT _required = 0;
+                    _nodeMasks(_node, nullptr, 0, &_required);
+                    _masks.resize(_required);
+                    if (!_required || !_nodeMasks(_node, _masks.data(), _required, &_required))
+                    {
+                        continue;
+                    }
+                    _masks.resize(_required);
+                }
+                else
+                {
+                    // before Windows 11 a node never spans groups, so its one group is all of it
+                    _masks.resize(1);
+                    if (!GetNumaNodeProcessorMaskEx(_node, &_masks[0]))
+                    {
+                        continue;
+                    }
+                }
+                for (auto& _mask : _masks)
+                {
+                    _appendGroup(_nodes[_n], _mask.Group, _mask.Mask);
+                }
+            }
+        }
+        inline static void _appendGroup(std::vector<unsigned>& _processors, WORD _group, KAFFINITY _mask)
+        {
+            for (unsigned _bit = 0; _bit < PROCESSORS_PER_GROUP; _bit++)
+            {
+                if (_mask & (KAFFINITY(1) << _bit))
+                {
+                    _processors.push_back(_group * PROCESSORS_PER_GROUP + _bit);
+                }
+            }
+        }
+        // Every active processor, group by group, numbered as _detect() numbers them. Only if
+        // the OS reports no groups either, hardware threads 0..n-1, as if in group 0.
+        inline static std::vector<unsigned> _getActiveProcessors()
+        {
+            std::vector<unsigned> _processors;
+            DWORD _bytes = 0;
+            GetLogicalProcessorInformationEx(RelationGroup, nullptr, &_bytes);
+            std::vector<uint8_t> _buffer(_bytes);
+            auto _info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(_buffer.data());
+            if (_bytes && GetLogicalProcessorInformationEx(RelationGroup, _info, &_bytes))
+            {
+                for (WORD _g = 0; _g < _info->Group.ActiveGroupCount; _g++)
+                {
+                    _appendGroup(_processors, _g, _info->Group.GroupInfo[_g].ActiveProcessorMask);
+                }
+            }
+            if (_processors.empty())
+            {
+                for (unsigned _p = 0; _p < max(1u, std::thread::hardware_concurrency()); _p++)
+                {
+                    _processors.push_back(_p);
+                }
+            }
+            return _processors;
+        }
+        inline static size_t _getPageSize()
+        {
+            SYSTEM_INFO _info;
+            GetSystemInfo(&_info);
+            return _info.dwPageSize;
+        }
+        inline static void _queryNodes(uintptr_t _first, size_t _pageSize, std::vector<int>& _pageNodes)
+        {
+            std::vector<PSAPI_WORKING_SET_EX_INFORMATION> _info(_pageNodes.size());
+            for (size_t _i = 0; _i < _info.size(); _i++)
+            {
+                _info[_i].VirtualAddress = reinterpret_cast<PVOID>(_first + _i * _pageSize);
+            }
+            if (!QueryWorkingSetEx(GetCurrentProcess(), _info.data(),
+                                   static_cast<DWORD>(_info.size() * sizeof(_info[0]))))
+            {
+                return;
+            }
+            for (size_t _i = 0; _i < _info.size(); _i++)
+            {
+                if (_info[_i].VirtualAttributes.Valid)
+                {
+                    _pageNodes[_i] = static_cast<int>(_info[_i].VirtualAttributes.Node);
+                }
+            }
+        }
+    };
+};
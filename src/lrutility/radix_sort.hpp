@@ -0,0 +1,48 @@
+#pragma once
+#include "../lrutility.hpp"
+
+namespace lightroom
+{
+    // Stable LSD radix sort on a 64-bit key, one byte per pass. Passes where every key has the
+    // same byte are skipped, so keys using few bits cost few passes. _scratch is working storage
+    // and may be kept between calls to avoid reallocating.
+    template <typename _T, typename _KeyOf>
+    void radixSort(std::vector<_T>& _items, std::vector<_T>& _scratch, _KeyOf&& _keyOf)
+    {
+        size_t _count = _items.size();
+        if (_count < 2)
+        {
+            return;
+        }
+        size_t _histograms[8][256] = {};
+        for (auto& _item : _items)
+        {
+            uint64_t _key = _keyOf(_item);
+            for (int _b = 0; _b < 8; _b++)
+            {
+                _histograms[_b][(_key >> (8 * _b)) & 0xff]++;
+            }
+        }
+        _scratch.resize(_count);
+        for (int _b = 0; _b < 8; _b++)
+        {
+            auto& _histogram = _histograms[_b];
+            if (_histogram[(_keyOf(_items[0]) >> (8 * _b)) & 0xff] == _count)
+            {
+                continue;
+            }
+            size_t _offset = 0;
+            for (auto& _bucket : _histogram)
+            {
+                size_t _size = _bucket;
+                _bucket = _offset;
+                _offset += _size;
+            }
+            for (auto& _item : _items)
+            {
+                _scratch[_histogram[(_keyOf(_item) >> (8 * _b)) & 0xff]++] = std::move(_item);
+            }
+            _items.swap(_scratch);
+        }
+    }
+};
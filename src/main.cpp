@@ -1,6 +1,7 @@
 #include "Samples/input_type.hpp"
 #include "Samples/texture.hpp"
 #include "Samples/colored_vertex.hpp"
+#include "Samples/line_batch.hpp"
 using namespace lightroom;
 using namespace std;
 
@@ -10,4 +11,5 @@ int main(int argc, char* argv[])
     sample::InputType();
     sample::ColoredVertex();
     sample::Textured();
+    sample::LineBatch();
 }
\ No newline at end of file
@@ -3,5 +3,6 @@
 #define _PIPELINE_
 
 #include "pipeline/pipeline_utility.hpp"
+#include "pipeline/batch_renderer.hpp"
 
 #endif // !_PIPELINE_
@@ -0,0 +1,74 @@
+#pragma once
+#include "pipeline_utility.hpp"
+
+namespace lightroom
+{
+    // Renders many small, independent scenes, e.g. thumbnails. Every scene gets its own headless
+    // Pipeline, run start to finish by one job on a serial job system, so each worker takes whole
+    // renders instead of several workers splitting one. Scenes may share meshes and textures:
+    // rendering only reads them.
+    template <typename _VertexType, typename _LineType, typename _TriangleType>
+    class BatchRenderer
+    {
+    public:
+        using PipelineType = Pipeline<_VertexType, _LineType, _TriangleType>;
+
+        struct Scene
+        {
+            Camara camara;
+            WritableColorMap* target;   // drawn into; holds the frame once render() returns
+            std::function<void(PipelineType& _pipeline)> record;   // materials and draws, run on a worker
+            std::function<void(const Viewport& _viewport)> resolved = nullptr;  // optional, gets the packed pixels
+        };
+        struct Stats
+        {
+            size_t frames;
+            double seconds;
+            double framesPerSecond;
+        };
+
+    protected:
+        JobSystem& _jobs;
+        Stats _total = {};
+
+    public:
+        BatchRenderer(JobSystem& _jobs = JobSystem::getDefault()) : _jobs(_jobs) {}
+
+        // Renders every scene, returning once all are done; targets must be distinct.
+        // Returns this batch's throughput.
+        Stats render(const std::vector<Scene>& _scenes)
+        {
+            auto _start = std::chrono::steady_clock::now();
+            _jobs.parallelFor(_scenes.size(), [&](size_t _i)
+            {
+                auto& _scene = _scenes[_i];
+                PipelineType _pipeline(_scene.camara, _scene.target, Headless{}, JobSystem::getSerial());
+                _scene.record(_pipeline);
+                _pipeline.render();
+                if (_scene.resolved)
+                {
+                    _scene.resolved(_pipeline.viewport);
+                }
+            });
+            double _seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+            _total = _makeStats(_total.frames + _scenes.size(), _total.seconds + _seconds);
+            return _makeStats(_scenes.size(), _seconds);
+        }
+
+        // Totals over every render() since construction or the last resetStats()
+        inline Stats getStats() const
+        {
+            return _total;
+        }
+        void resetStats()
+        {
+            _total = {};
+        }
+
+    protected:
+        inline static Stats _makeStats(size_t _frames, double _seconds)
+        {
+            return { _frames, _seconds, _seconds > 0 ? _frames / _seconds : 0 };
+        }
+    };
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include "../lrutility.hpp"
+#include "../drawing.hpp"
+#include "material.hpp"
+
+namespace lightroom
+{
+    // Draws recorded away from the pipeline, typically one list per traversal thread. Recording
+    // touches nothing shared; Pipeline::submit() queues the list and render() merges every
+    // queued list in order. Meshes are referenced, not copied, and must stay alive and
+    // unchanged until render().
+    template <typename _VertexInType> requires std::is_convertible_v<const _VertexInType*, const Vertex3DIn*>
+    class CommandList
+    {
+    public:
+        struct Draw
+        {
+            const std::vector<_VertexInType*>* mesh;
+            TransformMixer3D transform;     // model transform, applied before the camera's
+            PrimitiveInputType inputType;
+            MaterialId material;
+        };
+
+    protected:
+        std::vector<Draw> _draws;
+        std::vector<std::pair<const LineSegment3D*, size_t>> _lineBatches;
+
+    public:
+        // Empty meshes are skipped
+        inline void draw(const std::vector<_VertexInType*>& _mesh, PrimitiveInputType _inputType,
+                         MaterialId _material = 0, const TransformMixer3D& _transform = TransformMixer3D())
+        {
+            if (!_mesh.empty())
+            {
+                _draws.push_back({ &_mesh, _transform, _inputType, _material });
+            }
+        }
+        // As Pipeline::inputLines(); the array must stay alive until the frame has been presented
+        inline void drawLines(const std::vector<LineSegment3D>& _segments)
+        {
+            if (!_segments.empty())
+            {
+                _lineBatches.emplace_back(_segments.data(), _segments.size());
+            }
+        }
+        inline void clear()
+        {
+            _draws.clear();
+            _lineBatches.clear();
+        }
+
+        inline const std::vector<Draw>& getDraws() const
+        {
+            return _draws;
+        }
+        inline const std::vector<std::pair<const LineSegment3D*, size_t>>& getLineBatches() const
+        {
+            return _lineBatches;
+        }
+        inline bool empty() const
+        {
+            return _draws.empty() && _lineBatches.empty();
+        }
+    };
+};
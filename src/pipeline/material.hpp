@@ -0,0 +1,129 @@
+#pragma once
+#include "../lrutility.hpp"
+#include "../texture.hpp"
+
+namespace lightroom
+{
+    // Shading state shared by every primitive of a draw. Primitives carry only a MaterialId;
+    // the pipeline resolves it once per primitive, before rasterization.
+    // Vertex UVs are mapped through uvScale and uvOffset, which place atlased textures in their page,
+    // then clamped to [uvMin, uvMax] so that an atlas entry never samples its neighbours.
+    // state selects the triangle raster loop: culling, depth test and write, blending, interpolation.
+    struct Material
+    {
+        const TextureMap* texture = nullptr;
+        TextureSampler sampler{ TextureFilter::TRILINEAR, AddressMode::CLAMP, AddressMode::CLAMP };
+        Color baseColor{ 1, 1, 1, 1 };
+        UVCoordinate uvScale{ 1, 1 };
+        UVCoordinate uvOffset{ 0, 0 };
+        UVCoordinate uvMin = UVCoordinate::Constant(-std::numeric_limits<Float>::infinity());
+        UVCoordinate uvMax = UVCoordinate::Constant(std::numeric_limits<Float>::infinity());
+        PipelineState state;
+
+        inline UVCoordinate remap(const UVCoordinate& _uv) const
+        {
+            return (_uv.cwiseProduct(uvScale) + uvOffset).cwiseMax(uvMin).cwiseMin(uvMax);
+        }
+
+        // Samples _entry of an atlas page, clamped to the entry's own rectangle. Materials on the
+        // same page with the same sampler and state share a batch, so their draws sort together.
+        static Material fromAtlas(const TextureMap* _page, const AtlasEntry& _entry)
+        {
+            Material _material;
+            _material.texture = _page;
+            _material.uvScale = _entry.uvScale;
+            _material.uvOffset = _entry.uvOffset;
+            _material.uvMin = _entry.uvOffset;
+            _material.uvMax = _entry.uvOffset + _entry.uvScale;
+            return _material;
+        }
+
+        // Whether draws with either material can run back to back without changing texture,
+        // sampler or raster loop
+        inline bool batchesWith(const Material& _other) const
+        {
+            return texture == _other.texture && state.index() == _other.state.index() &&
+                sampler.filter == _other.sampler.filter && sampler.addressU == _other.sampler.addressU &&
+                sampler.addressV == _other.sampler.addressV && sampler.lodBias == _other.sampler.lodBias;
+        }
+    };
+
+    // Id 0 is the default untextured white material
+    class MaterialTable
+    {
+    protected:
+        inline static std::atomic<uint64_t> _nextVersion = 1;
+
+        std::vector<Material> _materials{ Material() };
+        std::vector<MaterialId> _batches{ 0 };      // batch of each material, numbered by first use
+        std::unordered_multimap<const TextureMap*, MaterialId> _batchHeads;  // first material of each batch
+        MaterialId _batchCount = 1;
+        uint64_t _version = 0;
+
+    public:
+        static constexpr size_t MAX_MATERIALS = size_t(1) << (8 * sizeof(MaterialId));
+
+        // Throws std::length_error once every MaterialId is taken rather than wrapping to an existing id
+        inline MaterialId add(const Material& _material)
+        {
+            if (_materials.size() >= MAX_MATERIALS)
+            {
+                throw std::length_error("MaterialTable: every MaterialId is in use");
+            }
+            _materials.push_back(_material);
+            _batches.push_back(_findBatch(_material));
+            _touch();
+            return static_cast<MaterialId>(_materials.size() - 1);
+        }
+        // Materials added with the same texture, sampler and state share a batch id; the id is
+        // fixed when the material is added
+        inline MaterialId getBatch(MaterialId _id) const
+        {
+            return _batches[_id];
+        }
+        inline const Material& operator[](MaterialId _id) const
+        {
+            return _materials[_id];
+        }
+        // Counts as an edit: the next frame snapshots the table again
+        inline Material& operator[](MaterialId _id)
+        {
+            _touch();
+            return _materials[_id];
+        }
+        inline size_t size() const
+        {
+            return _materials.size();
+        }
+        // Changes on every add() and every mutable access, and differs between tables edited
+        // apart, so a snapshot taken at one version still matches the table at that version
+        inline uint64_t getVersion() const
+        {
+            return _version;
+        }
+
+    protected:
+        inline void _touch()
+        {
+            _version = _nextVersion.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        MaterialId _findBatch(const Material& _material)
+        {
+            if (_material.batchesWith(_materials[0]))
+            {
+                return 0;
+            }
+            auto [_begin, _end] = _batchHeads.equal_range(_material.texture);
+            for (auto _head = _begin; _head != _end; ++_head)
+            {
+                if (_material.batchesWith(_materials[_head->second]))
+                {
+                    return _batches[_head->second];
+                }
+            }
+            _batchHeads.emplace(_material.texture, static_cast<MaterialId>(_materials.size() - 1));
+            return _batchCount++;
+        }
+    };
+};
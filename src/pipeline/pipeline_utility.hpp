@@ -4,6 +4,8 @@
 
 #include "../lrutility.hpp"
 #include "../drawing.hpp"
+#include "material.hpp"
+#include "command_list.hpp"
 
 namespace lightroom
 {
@@ -55,6 +57,42 @@ namespace lightroom
         return -cos(fov / 2) / sin(fov / 2);
     }
 
+    enum class DrawPass : uint8_t
+    {
+        SOLID,      // front to back, so early depth rejection drops most hidden work
+        BLENDED     // materials with alpha blending; back to front, after every solid draw
+    };
+
+    // One draw of a frame: count vertices from first in the frame's vertex array
+    struct DrawCommand
+    {
+        size_t first;
+        size_t count;
+        PrimitiveInputType inputType;
+        MaterialId material;
+        uint64_t sortKey;
+        uint32_t run = 0;   // draws are only reordered within a run; see Pipeline::_transformVertices
+
+        // High bits first: pass (2), coarse depth (16), batch (16), fine depth (14), material (16).
+        // Depth is the draw's nearest screen-space z; draws in one depth bucket (under 1% of z)
+        // group by material batch, so draws sharing an atlas page run back to back.
+        static uint64_t makeSortKey(DrawPass _pass, Float _depth, MaterialId _batch, MaterialId _material)
+        {
+            float _z = static_cast<float>(_depth);
+            uint32_t _bits;
+            memcpy(&_bits, &_z, sizeof(_bits));
+            // as unsigned, ordered like the floats: negatives have every bit flipped, positives the sign
+            _bits ^= (_bits & 0x80000000u) ? 0xffffffffu : 0x80000000u;
+            // greater z is nearer, so solid draws take the inverted depth to come nearest first
+            if (_pass == DrawPass::SOLID)
+            {
+                _bits = ~_bits;
+            }
+            return (static_cast<uint64_t>(_pass) << 62) | (static_cast<uint64_t>(_bits >> 16) << 46) |
+                (static_cast<uint64_t>(_batch) << 30) | (static_cast<uint64_t>((_bits >> 2) & 0x3fff) << 16) | _material;
+        }
+    };
+
 
     template <
         typename _VertexType,
@@ -68,133 +106,564 @@ namespace lightroom
     public:
         Camara camara;
         Viewport viewport;
+        MaterialTable materials;
+        JobSystem& jobs;
 
     private:
         using VertexContainer = std::vector<_VertexType>;
+        using LineBatchList = std::vector<std::pair<const LineSegment3D*, size_t>>;
+
+        // Everything one submitted frame reads, so the next frame can be recorded meanwhile
+        struct Frame
+        {
+            Camara camara;
+            std::shared_ptr<const MaterialTable> materials;     // shared by frames until an edit
+            VertexContainer vertices;
+            std::vector<DrawCommand> draws;             // in recording order until sorted
+            std::vector<DrawCommand> sortScratch;
+            std::vector<TransformMixer3D> drawTransforms;   // model transforms, in recording order
+            std::vector<size_t> drawChunks;     // first transform chunk of each draw, then the total
+            std::vector<Float> chunkNearest;    // nearest z of each transform chunk
+            std::vector<GraphObj3D*> primitives;
+            LineBatchList lineBatches;
+            JobHandle geometry;     // transform and assembly
+            std::optional<std::promise<void>> resolved;     // renderAsync() frames only
+
+            Frame(const Camara& camara) : camara(camara) {}
+        };
+
+        // A submitted command list, merged into the recording by render()
+        struct PendingList
+        {
+            size_t order;
+            size_t sequence;    // arrival under _submitMutex, so only orders one thread's lists
+            std::function<void()> merge;
+        };
+
+        // Selects the constructor the public ones share; _viewportArgs follow output to viewport
+        struct _Construct {};
+        template <typename... _ViewportArgs>
+        Pipeline(_Construct,
+                        const Camara& camara,
+                        WritableColorMap* output,
+                        JobSystem& _jobs,
+                        unsigned _framesInFlight,
+                        _ViewportArgs&&... _viewportArgs) :
+            _depthBuffer(output->getLayout(), _placedWith(output, _jobs)),
+            camara(camara),
+            viewport(output, std::forward<_ViewportArgs>(_viewportArgs)...),
+            jobs(_jobs),
+            _framesInFlight(max(1u, _framesInFlight)),
+            _lineBatchRenderer(64, 0, _jobs),
+            _isa(CpuFeatures::getIsa()) {}
 
+        // the frame being recorded by input() and inputLines(); one draw per input() call or
+        // command list draw, in order
         VertexContainer _vertices;
-        std::vector<GraphObj3D*> _primitives;
+        std::vector<DrawCommand> _draws;
+        std::vector<TransformMixer3D> _drawTransforms;
+        LineBatchList _lineBatches;
+        std::vector<PendingList> _pendingLists;
+        std::mutex _submitMutex;
+        std::shared_ptr<const MaterialTable> _materialSnapshot;    // frames share it until materials changes
+
+        unsigned _framesInFlight;
+        std::deque<std::unique_ptr<Frame>> _submitted;  // oldest first
+        std::vector<std::unique_ptr<Frame>> _spare;     // retired frames, reused for their buffers
+        std::mutex _spareMutex;     // present jobs retire renderAsync() frames
+        std::deque<JobHandle> _asyncPresents;   // renderAsync() frames' present jobs, oldest first
+        std::deque<std::optional<std::promise<void>>> _chainFrames;     // one per frame handed to the swap chain
+        std::mutex _chainMutex;
+        uint64_t _chainFrameCount = 0;  // swap chain frame number the next submitted frame will be
         DepthBuffer _depthBuffer;
+        LineBatchRenderer _lineBatchRenderer;
+        SwapChain* _swapChain = nullptr;
+        IsaLevel _isa;
 
     public:
+        // Vertex processing, line binning and raster, and the resolve run on _jobs.
+        // _framesInFlight frames may be submitted before the oldest is presented; with 1,
+        // render() presents the frame before it returns.
+        // The CPU is probed here, so the SIMD kernels are chosen before the first frame.
         Pipeline(const Camara& camara,
-                        WritableColorMap* output) :
-            _depthBuffer(viewport.getWidth() * viewport.getHeight(), -1),
-            camara(camara),
-            viewport(output) {}
+                        WritableColorMap* output,
+                        JobSystem& _jobs = JobSystem::getDefault(),
+                        unsigned _framesInFlight = 1) :
+            Pipeline(_Construct{}, camara, output, _jobs, _framesInFlight) {}
+        // Renders without a window into output, sized as output; viewport resolves each frame
+        // into its pixel buffer (Viewport::getPixels). Headless pipelines share nothing but
+        // _jobs, so any number may render side by side, each on its own thread.
+        Pipeline(const Camara& camara,
+                        WritableColorMap* output,
+                        Headless,
+                        JobSystem& _jobs = JobSystem::getDefault(),
+                        unsigned _framesInFlight = 1) :
+            Pipeline(_Construct{}, camara, output, _jobs, _framesInFlight, Headless{}) {}
+        // Draws into the swap chain's back buffers; the chain's present thread resolves them
+        // through viewport, so raster of a frame overlaps the resolve of the one before. Only
+        // the thread calling render(), renderAsync() and flush() blits to the window.
+        Pipeline(const Camara& camara,
+                        SwapChain& _swapChain,
+                        JobSystem& _jobs = JobSystem::getDefault(),
+                        unsigned _framesInFlight = 1) :
+            Pipeline(camara, _swapChain.getBuffer(0), _jobs, _framesInFlight)
+        {
+            this->_swapChain = &_swapChain;
+            _chainFrameCount = _swapChain.getSubmittedCount();
+            _swapChain.start([this](const SequenceMap& _frame)
+            {
+                viewport.resolve(_frame, jobs);
+                _resolveChainFrame();
+            });
+        }
         ~Pipeline()
         {
+            flush();
             clear();
+            if (_swapChain)
+            {
+                _swapChain->stop();
+            }
         }
 
+        // Submits the recorded frame with a snapshot of camara and materials, and starts its
+        // vertex and setup work on the job system. Once _framesInFlight frames are pending, the
+        // oldest is rasterized and presented on the calling thread, overlapping the newer
+        // frames' geometry; with a swap chain, the frames its present thread has resolved since
+        // are blitted here too, so the window is only ever touched from this thread. Without a
+        // swap chain a SequenceMap output is wiped before each frame is drawn, by render() and
+        // renderAsync() alike, and holds the last frame afterwards. Recording starts over empty.
         void render()
         {
-            _mvpTransform();
-            _perspectiveDivision();
-            _viewportTransform();
-            _assemble();
-            _verticesPostProcess();
+            _waitAsync();
+            _submitted.push_back(_submitFrame());
+            while (_submitted.size() >= _framesInFlight)
+            {
+                _present();
+            }
+            viewport.blit();
+        }
 
-            for (auto _primitive : _primitives)
+        // As render(), but the frame is rasterized and resolved by a job, so the caller goes on
+        // with input and simulation meanwhile. The future is ready once the frame is resolved
+        // (headless: in viewport.getPixels()); a window shows it at this thread's next render(),
+        // renderAsync() or flush(), as only this thread touches the window. Without a swap
+        // chain every frame draws into the one output, so the jobs run one after another, each
+        // wiping it once the previous one is resolved. Frames present in submission
+        // order; once _framesInFlight of them are pending the call waits for the oldest. Frames
+        // still pending from render() are presented first.
+        std::future<void> renderAsync()
+        {
+            viewport.blit();
+            while (!_submitted.empty())
+            {
+                _present();
+            }
+            while (!_asyncPresents.empty() && _asyncPresents.front()->isDone())
+            {
+                _asyncPresents.pop_front();
+            }
+            while (_asyncPresents.size() >= _framesInFlight)
+            {
+                jobs.wait(_asyncPresents.front());
+                _asyncPresents.pop_front();
+            }
+            auto _frame = _submitFrame();
+            auto _future = _frame->resolved.emplace().get_future();
+            if (_swapChain)
             {
-                _primitive->draw(viewport.output, _depthBuffer, camara.getNPlain(), camara.f);
+                // the job must find its back buffer free: the present thread, which frees buffers,
+                // may be the thread that runs it
+                _swapChain->waitBuffer(_chainFrameCount - 1);
             }
-            viewport.print();
+            // presents share the depth buffer and the output, so each waits for the one before
+            JobHandle _previous = _asyncPresents.empty() ? nullptr : _asyncPresents.back();
+            JobHandle _geometry = _frame->geometry;
+            auto _submittedFrame = _frame.release();
+            _asyncPresents.push_back(jobs.submit([this, _submittedFrame]()
+            {
+                _presentFrame(std::unique_ptr<Frame>(_submittedFrame));
+            }, { _geometry, _previous }));
+            return _future;
+        }
 
-            _clearInternalData();
+        // Rasterizes and presents every submitted frame
+        void flush()
+        {
+            while (!_submitted.empty())
+            {
+                _present();
+            }
+            _waitAsync();
+            if (_swapChain)
+            {
+                _swapChain->waitIdle();
+            }
+            viewport.blit();
         }
 
+        // Drops what has been recorded since the last render(), submitted command lists included
         void clear()
         {
-            _clearInternalData();
             _clearVertices();
+            std::lock_guard<std::mutex> _lock(_submitMutex);
+            _pendingLists.clear();
         }
 
+        inline unsigned getFramesInFlight() const
+        {
+            return _framesInFlight;
+        }
+        // Instruction set the SIMD kernels dispatch on; see CpuFeatures::getIsa()
+        inline IsaLevel getIsa() const
+        {
+            return _isa;
+        }
+        // Frames submitted but not yet presented
+        inline size_t getPendingFrameCount() const
+        {
+            return _submitted.size() + std::count_if(_asyncPresents.begin(), _asyncPresents.end(),
+                                                      [](const JobHandle& _present) { return !_present->isDone(); });
+        }
+
+        // Every primitive assembled from this draw uses _material from the pipeline's material table
         template <typename  _VertexInType> requires std::is_convertible_v<const  _VertexInType*, const Vertex3DIn*> 
-        inline void input(PrimitiveInputType _inputType, const std::vector<_VertexInType*>& _vertexIns)
+        inline void input(PrimitiveInputType _inputType, const std::vector<_VertexInType*>& _vertexIns,
+                          MaterialId _material = 0)
         {
-            for (auto& _v : _vertexIns)
-            {
-                _vertices.emplace_back(_v, _inputType);
-            }
-            _vertices.emplace_back(_vertexIns[0], PrimitiveInputType::NONE);
+            _record(_vertexIns, _inputType, _material, TransformMixer3D());
         }
 
-    private:
-        void _clearInternalData()
+        // Queues a command list for the next render(); safe to call from several threads.
+        // Lists are merged after the draws made with input(), by ascending _order; the raster
+        // keeps that order for draws that skip the depth test, and only reorders the depth
+        // tested draws between them, which changes nothing but ties. Lists with
+        // the same _order merge in the order submit() took the lock, which is only deterministic
+        // when they are submitted from one thread; threads that need a fixed order give their
+        // lists distinct _order values. The list must stay alive until render().
+        template <typename  _VertexInType>
+        void submit(const CommandList<_VertexInType>& _list, size_t _order = 0)
         {
-            _depthBuffer.clear();
+            std::lock_guard<std::mutex> _lock(_submitMutex);
+            _pendingLists.push_back({ _order, _pendingLists.size(), [this, &_list]()
+            {
+                for (auto& _draw : _list.getDraws())
+                {
+                    _record(*_draw.mesh, _draw.inputType, _draw.material, _draw.transform);
+                }
+                _lineBatches.insert(_lineBatches.end(), _list.getLineBatches().begin(), _list.getLineBatches().end());
+            } });
+        }
 
-            for (auto _go : _primitives)
+        // Queues a contiguous array of LINES segments for the batch line renderer.
+        // The array is not copied and must stay alive until the frame has been presented.
+        inline void inputLines(const std::vector<LineSegment3D>& _segments)
+        {
+            if (!_segments.empty())
             {
-                delete _go;
+                _lineBatches.emplace_back(_segments.data(), _segments.size());
             }
-            _primitives.clear();
         }
-        void _clearVertices()
+
+        inline const LineBatchRenderer& getLineBatchRenderer() const
         {
-            _vertices.clear();
+            return _lineBatchRenderer;
         }
 
-        inline void _verticesPostProcess()
+    private:
+        // Snapshots camara and materials, takes over the recording and starts the frame's geometry job
+        std::unique_ptr<Frame> _submitFrame()
         {
-            for (auto& _v : _vertices)
+            _mergeCommandLists();
+            std::unique_ptr<Frame> _frame;
             {
-                [[unlikely]]
-                if (_v.primitiveType == PrimitiveInputType::NONE)
+                std::lock_guard<std::mutex> _lock(_spareMutex);
+                if (!_spare.empty())
                 {
-                    continue;
+                    _frame = std::move(_spare.back());
+                    _spare.pop_back();
                 }
-                _v.afterAssemble();
             }
+            if (_frame)
+            {
+                _frame->camara = camara;
+            }
+            else
+            {
+                _frame = std::make_unique<Frame>(camara);
+            }
+            if (!_materialSnapshot || _materialSnapshot->getVersion() != materials.getVersion())
+            {
+                _materialSnapshot = std::make_shared<const MaterialTable>(materials);
+            }
+            _frame->materials = _materialSnapshot;
+            // swapped rather than moved, so the recording reuses the retired frame's capacity
+            std::swap(_frame->vertices, _vertices);
+            std::swap(_frame->draws, _draws);
+            std::swap(_frame->drawTransforms, _drawTransforms);
+            std::swap(_frame->lineBatches, _lineBatches);
+            _clearVertices();
+
+            auto _submittedFrame = _frame.get();
+            _frame->geometry = jobs.submit([this, _submittedFrame]()
+            {
+                _transformVertices(*_submittedFrame);
+                _assemble(*_submittedFrame);
+            });
+            if (_swapChain)
+            {
+                _chainFrameCount++;
+            }
+            return _frame;
         }
 
-        void _assemble()
+        void _waitAsync()
         {
-            auto _end = _vertices.end();
-            auto _first = _vertices.begin();
-            if (_end == _first)
+            for (auto& _present : _asyncPresents)
             {
-                return;
+                jobs.wait(_present);
             }
-            for (auto _last = _first; ++_last != _end;)
+            _asyncPresents.clear();
+        }
+
+        // Sets up every primitive, then splits the target into bands of whole depth-tile rows.
+        // Each band draws all primitives in order, so the image does not depend on how many
+        // threads took part.
+        void _rasterize(Frame& _frame, WritableColorMap* _output)
+        {
+            auto& _primitives = _frame.primitives;
+            Float _nplain = _frame.camara.getNPlain(), _fplain = _frame.camara.f;
+            jobs.parallelFor(_primitives.size(), [&](size_t _i)
             {
-                if ((*_last).primitiveType != (*_first).primitiveType)
+                auto& _material = (*_frame.materials)[_primitives[_i]->material];
+                _primitives[_i]->prepare(_output, _nplain, _fplain, &_material, _material.state);
+            }, 64);
+
+            // an output placed with jobs' workers is drawn by the owner of each row, so colour
+            // and depth writes land on the owner's node
+            if (_placedWith(_output, jobs))
+            {
+                auto _placed = static_cast<SequenceMap*>(_output);
+                jobs.forEachWorker([&](unsigned _worker)
                 {
-                    _assembleDeliver(_first, _last);
-                    _first = ++_last;
-                    if (_first == _end)
+                    auto [_first, _last] = _placed->getOwnedRows(_worker);
+                    if (_first >= _last)
+                    {
+                        return;
+                    }
+                    for (auto _primitive : _primitives)
                     {
-                        break;
+                        _primitive->drawRows(_output, _depthBuffer, _first, _last - 1);
                     }
+                });
+                return;
+            }
+            // a few bands per thread, so that bands crossing dense geometry can be balanced
+            constexpr int _tileSize = PixelLayout::TILE_SIZE;
+            int _height = _output->getHeight();
+            int _tileRows = (_height + _tileSize - 1) / _tileSize;
+            int _bandTiles = max(1, _tileRows / (4 * static_cast<int>(jobs.getThreadCount() + 1)));
+            int _bandRows = _bandTiles * _tileSize;
+            jobs.parallelFor(static_cast<size_t>((_tileRows + _bandTiles - 1) / _bandTiles), [&](size_t _b)
+            {
+                int _rowMin = static_cast<int>(_b) * _bandRows;
+                int _rowMax = min(_height, _rowMin + _bandRows) - 1;
+                for (auto _primitive : _primitives)
+                {
+                    _primitive->drawRows(_output, _depthBuffer, _rowMin, _rowMax);
+                }
+            });
+        }
+
+        // _jobs if _output is a SequenceMap placed with _jobs' workers (see SequenceMap), else null
+        inline static JobSystem* _placedWith(WritableColorMap* _output, JobSystem& _jobs)
+        {
+            auto _sequence = dynamic_cast<SequenceMap*>(_output);
+            return _sequence && _sequence->getOwners() == &_jobs ? &_jobs : nullptr;
+        }
+
+        // Presents the oldest frame submitted by render()
+        void _present()
+        {
+            auto _frame = std::move(_submitted.front());
+            _submitted.pop_front();
+            _presentFrame(std::move(_frame));
+        }
+        // Rasterizes and presents _frame, then keeps it for reuse
+        void _presentFrame(std::unique_ptr<Frame> _frame)
+        {
+            jobs.wait(_frame->geometry);
+            _frame->geometry = nullptr;
+            _verticesPostProcess(*_frame);
+            if (_swapChain)
+            {
+                viewport.output = _swapChain->getBackBuffer();
+            }
+            else if (auto _sequence = dynamic_cast<SequenceMap*>(viewport.output))
+            {
+                // every frame draws on a wiped SequenceMap, whichever call presents it, and the
+                // output keeps the frame until the next one; the caller can not wipe it, as a
+                // renderAsync() job may still be drawing
+                _sequence->wipe();
+            }
+
+            auto& _camara = _frame->camara;
+            _rasterize(*_frame, viewport.output);
+            if (!_frame->lineBatches.empty())
+            {
+                auto _toClip = _createMvpMixer(_camara);
+                auto _toScreen = _createViewportMixer();
+                // the camera looks down -z, so w is negative in front of it, and the projection
+                // puts the near plane at z = w
+                const float _nearPlane[4] = { 0, 0, 1, -1 };
+                for (auto& [_segments, _count] : _frame->lineBatches)
+                {
+                    _lineBatchRenderer.render(_segments, _count, _toClip, _toScreen, viewport.output, &_depthBuffer,
+                                              _nearPlane);
                 }
             }
+            // with a swap chain, the present thread fulfils this once it has resolved the frame
+            auto _resolved = std::move(_frame->resolved);
+            _frame->resolved.reset();
+            if (_swapChain)
+            {
+                {
+                    std::lock_guard<std::mutex> _lock(_chainMutex);
+                    _chainFrames.push_back(std::move(_resolved));
+                }
+                _resolved.reset();
+                _swapChain->present();
+            }
+            else if (_resolved)
+            {
+                viewport.resolve(*viewport.output, jobs);
+            }
+            else
+            {
+                viewport.print(NULL, jobs);
+            }
+
+            _depthBuffer.clear();
+            for (auto _go : _frame->primitives)
+            {
+                delete _go;
+            }
+            _frame->primitives.clear();
+            _frame->vertices.clear();
+            _frame->draws.clear();
+            _frame->drawTransforms.clear();
+            _frame->lineBatches.clear();
+            {
+                std::lock_guard<std::mutex> _lock(_spareMutex);
+                _spare.push_back(std::move(_frame));
+            }
+            if (_resolved)
+            {
+                _resolved->set_value();
+            }
         }
-        void _assembleDeliver(
-            VertexContainer::iterator _begin, VertexContainer::iterator _end)
+        // Present thread: the frame handed over first has been resolved
+        void _resolveChainFrame()
+        {
+            std::optional<std::promise<void>> _resolved;
+            {
+                std::lock_guard<std::mutex> _lock(_chainMutex);
+                _resolved = std::move(_chainFrames.front());
+                _chainFrames.pop_front();
+            }
+            if (_resolved)
+            {
+                _resolved->set_value();
+            }
+        }
+        void _clearVertices()
+        {
+            _vertices.clear();
+            _draws.clear();
+            _drawTransforms.clear();
+            _lineBatches.clear();
+        }
+
+        template <typename  _VertexInType>
+        inline void _record(const std::vector<_VertexInType*>& _vertexIns, PrimitiveInputType _inputType,
+                            MaterialId _material, const TransformMixer3D& _transform)
         {
-            switch ((*_begin).primitiveType)
+            if (_vertexIns.empty())
+            {
+                return;
+            }
+            _draws.push_back({ _vertices.size(), _vertexIns.size(), _inputType, _material, 0 });
+            for (auto& _v : _vertexIns)
+            {
+                _vertices.emplace_back(_v, _inputType);
+            }
+            _drawTransforms.push_back(_transform);
+        }
+        void _mergeCommandLists()
+        {
+            std::vector<PendingList> _lists;
+            {
+                std::lock_guard<std::mutex> _lock(_submitMutex);
+                _lists.swap(_pendingLists);
+            }
+            std::sort(_lists.begin(), _lists.end(), [](const PendingList& _a, const PendingList& _b)
+                      {
+                          return _a.order != _b.order ? _a.order < _b.order : _a.sequence < _b.sequence;
+                      });
+            for (auto& _list : _lists)
+            {
+                _list.merge();
+            }
+        }
+
+        inline void _verticesPostProcess(Frame& _frame)
+        {
+            for (auto& _v : _frame.vertices)
+            {
+                _v.afterAssemble();
+            }
+        }
+
+        // Primitives come out in draw order, which _transformVertices has sorted
+        void _assemble(Frame& _frame)
+        {
+            for (auto& _draw : _frame.draws)
+            {
+                auto _begin = _frame.vertices.begin() + _draw.first;
+                _assembleDeliver(_frame.primitives, _begin, _begin + _draw.count, _draw.inputType, _draw.material);
+            }
+        }
+        void _assembleDeliver(std::vector<GraphObj3D*>& _primitives,
+            VertexContainer::iterator _begin, VertexContainer::iterator _end,
+            PrimitiveInputType _inputType, MaterialId _material)
+        {
+            size_t _first = _primitives.size();
+            switch (_inputType)
             {
                 case lightroom::PrimitiveInputType::LINES:
-                    _assembleLines(_begin, _end);
+                    _assembleLines(_primitives, _begin, _end);
                     break;
                 case lightroom::PrimitiveInputType::LINE_STRIP:
-                    _assembleLineStrip(_begin, _end);
+                    _assembleLineStrip(_primitives, _begin, _end);
                     break;
                 case lightroom::PrimitiveInputType::LINE_LOOP:
-                    _assembleLineLoop(_begin, _end);
+                    _assembleLineLoop(_primitives, _begin, _end);
                     break;
                 case lightroom::PrimitiveInputType::TRIANGLE_STRIP:
-                    _assembleTriangleStrip(_begin, _end);
+                    _assembleTriangleStrip(_primitives, _begin, _end);
                     break;
                 case lightroom::PrimitiveInputType::TRIANGLE_FAN:
-                    _assembleTriangleFan(_begin, _end);
+                    _assembleTriangleFan(_primitives, _begin, _end);
                     break;
                 default:
                     break;
             }
+            for (size_t _i = _first; _i < _primitives.size(); _i++)
+            {
+                _primitives[_i]->material = _material;
+            }
         }
-        inline void _assembleLines(
+        inline void _assembleLines(std::vector<GraphObj3D*>& _primitives,
             VertexContainer::iterator _begin, VertexContainer::iterator _end)
         {
             for (auto _i = _begin, _j = ++_begin; _i != _end && _j != _end; ++++_i, ++++_j)
@@ -202,7 +671,7 @@ namespace lightroom
                 _primitives.push_back(new _LineType({ &*_i, &*_j }));
             }
         }
-        inline void _assembleLineStrip(
+        inline void _assembleLineStrip(std::vector<GraphObj3D*>& _primitives,
             VertexContainer::iterator _begin, VertexContainer::iterator _end)
         {
             auto _i = _begin;
@@ -216,7 +685,7 @@ namespace lightroom
                 _primitives.push_back(new _LineType({ &*_i, &*_j }));
             }
         }
-        inline void _assembleLineLoop(
+        inline void _assembleLineLoop(std::vector<GraphObj3D*>& _primitives,
             VertexContainer::iterator _begin, VertexContainer::iterator _end)
         {
             auto __begin = _begin;
@@ -232,7 +701,7 @@ namespace lightroom
             }
             _primitives.push_back(new _LineType({ &*_i, &*_begin }));
         }
-        inline void _assembleTriangleStrip(
+        inline void _assembleTriangleStrip(std::vector<GraphObj3D*>& _primitives,
             VertexContainer::iterator _begin, VertexContainer::iterator _end)
         {
             auto _i = _begin;
@@ -248,7 +717,7 @@ namespace lightroom
                 _primitives.push_back(new _TriangleType({ &*_i, &*_j, &*_k }));
             }
         }
-        inline void _assembleTriangleFan(
+        inline void _assembleTriangleFan(std::vector<GraphObj3D*>& _primitives,
             VertexContainer::iterator _begin, VertexContainer::iterator _end)
         {
             auto _i = _begin;
@@ -264,13 +733,13 @@ namespace lightroom
             }
         }
 
-        void _mvpTransform()
+        TransformMixer3D _createMvpMixer(const Camara& _camara) const
         {
             TransformMixer3D _tm;
 
             Float _t = static_cast<lightroom::Float>(viewport.getHeight()) / viewport.getWidth();
-            Float _f = camara.f;
-            Float _n = camara.getNPlain();
+            Float _f = _camara.f;
+            Float _n = _camara.getNPlain();
             Matrix<4> _perspective, _ortho;
             _perspective <<
                 _n, 0, 0, 0,
@@ -284,35 +753,102 @@ namespace lightroom
                 0, 0, 0, 1;
 
             _tm.changeBase(
-                camara.position.toCartesian(),
-                camara.topDirection.toCartesian().cross(-camara.gazeDirection.toCartesian()),
-                camara.topDirection.toCartesian(),
-                -camara.gazeDirection.toCartesian())
+                _camara.position.toCartesian(),
+                _camara.topDirection.toCartesian().cross(-_camara.gazeDirection.toCartesian()),
+                _camara.topDirection.toCartesian(),
+                -_camara.gazeDirection.toCartesian())
                 .apply(_perspective)
                 .apply(_ortho);
-
-            for (auto& _v : _vertices)
-            {
-                _v.apply(_tm);
-            }
+            return _tm;
         }
-        void _perspectiveDivision()
-        {
-            for (auto& _v : _vertices)
-            {
-                _v.position.divide();
-            }
-        }
-        void _viewportTransform()
+        TransformMixer3D _createViewportMixer() const
         {
             TransformMixer3D _tm;
             _tm.scale(viewport.getWidth() / 2.0, -viewport.getHeight() / 2.0, 1)
                 .translate((viewport.getWidth() - 1.0) / 2, (viewport.getHeight() - 1.0) / 2, 0);
+            return _tm;
+        }
 
-            for (auto& _v : _vertices)
+        // Model and MVP transform, perspective division and viewport transform, in one pass per
+        // vertex; draws run side by side and large draws are split further. Each draw then gets
+        // its sort key, and the draws are put in key order within their run.
+        // A draw that skips the depth test, or a solid one that leaves depth unwritten, shows
+        // different pixels depending on what is drawn before or after it, so it keeps its place:
+        // it gets a run of its own, and the depth tested draws between two such draws share one.
+        void _transformVertices(Frame& _frame)
+        {
+            uint32_t _run = 0;
+            for (auto& _draw : _frame.draws)
             {
-                _v.apply(_tm);
+                auto& _state = (*_frame.materials)[_draw.material].state;
+                bool _line = _draw.inputType == PrimitiveInputType::LINES ||
+                    _draw.inputType == PrimitiveInputType::LINE_STRIP || _draw.inputType == PrimitiveInputType::LINE_LOOP;
+                if (_line || _state.depthTest == DepthTest::ALWAYS ||
+                    (!_state.depthWrite && _state.blend != BlendMode::ALPHA))
+                {
+                    _draw.run = ++_run;
+                    _run++;
+                }
+                else
+                {
+                    _draw.run = _run;
+                }
+            }
+
+            // one flat loop over fixed-size chunks of every draw's vertices, so a frame of a few
+            // huge draws spreads as well as one of many small ones
+            constexpr size_t _CHUNK = 256;
+            auto _toClip = _createMvpMixer(_frame.camara).matrix();
+            auto _toScreen = _createViewportMixer();
+            auto& _drawChunks = _frame.drawChunks;
+            _drawChunks.resize(_frame.draws.size() + 1);
+            _drawChunks[0] = 0;
+            for (size_t _d = 0; _d < _frame.draws.size(); _d++)
+            {
+                _frame.drawTransforms[_d].apply(_toClip);
+                _drawChunks[_d + 1] = _drawChunks[_d] + (_frame.draws[_d].count + _CHUNK - 1) / _CHUNK;
+            }
+            _frame.chunkNearest.resize(_drawChunks.back());
+            jobs.parallelFor(_drawChunks.back(), [&](size_t _c)
+            {
+                size_t _d = std::upper_bound(_drawChunks.begin(), _drawChunks.end(), _c) - _drawChunks.begin() - 1;
+                auto& _draw = _frame.draws[_d];
+                auto& _mvp = _frame.drawTransforms[_d];
+                // vertices at or behind the camera (w >= 0, as the camera looks down -z) are left
+                // out of the nearest z, since the divide mirrors them in front of it
+                Float _nearest = -std::numeric_limits<Float>::infinity();
+                size_t _begin = (_c - _drawChunks[_d]) * _CHUNK;
+                for (size_t _i = _begin; _i < (std::min)(_draw.count, _begin + _CHUNK); _i++)
+                {
+                    auto& _v = _frame.vertices[_draw.first + _i];
+                    _v.apply(_mvp);
+                    bool _inFront = _v.position[3] < 0;
+                    _v.position.divide();
+                    _v.apply(_toScreen);
+                    if (_inFront)
+                    {
+                        _nearest = max(_nearest, _v.position[2]);
+                    }
+                }
+                _frame.chunkNearest[_c] = _nearest;
+            });
+
+            for (size_t _d = 0; _d < _frame.draws.size(); _d++)
+            {
+                auto& _draw = _frame.draws[_d];
+                Float _nearest = -std::numeric_limits<Float>::infinity();
+                for (size_t _c = _drawChunks[_d]; _c < _drawChunks[_d + 1]; _c++)
+                {
+                    _nearest = max(_nearest, _frame.chunkNearest[_c]);
+                }
+                auto _pass = (*_frame.materials)[_draw.material].state.blend == BlendMode::ALPHA ?
+                    DrawPass::BLENDED : DrawPass::SOLID;
+                _draw.sortKey = DrawCommand::makeSortKey(_pass, _nearest, _frame.materials->getBatch(_draw.material),
+                                                         _draw.material);
             }
+            radixSort(_frame.draws, _frame.sortScratch, [](const DrawCommand& _draw) { return _draw.sortKey; });
+            // the sort is stable, so keys stay in order within each run
+            radixSort(_frame.draws, _frame.sortScratch, [](const DrawCommand& _draw) -> uint64_t { return _draw.run; });
         }
     };
 };
@@ -0,0 +1,35 @@
+#pragma once
+#include "test_utility.hpp"
+#include "../texture.hpp"
+
+// A second build() or a late add() used to repack the new images over the old entries and free
+// the pages materials point into; a built atlas now refuses both and keeps its pages
+LIGHTROOM_TEST(atlasBuildsOnce)
+{
+    using namespace lightroom;
+    TextureAtlas _atlas({ 64, 64 });
+    auto _image = [](int _width, int _height, Texel _texel)
+    {
+        auto _decoded = std::make_unique<DecodedImage>(PxCoordinate{ _width, _height });
+        for (int _y = 0; _y < _height; _y++)
+        {
+            std::fill(_decoded->getRow(_y), _decoded->getRow(_y) + _width, _texel);
+        }
+        return _decoded;
+    };
+    size_t _first = _atlas.add(_image(8, 8, 0xffff0000));
+    size_t _second = _atlas.add(_image(4, 12, 0xff00ff00));
+    if (!LIGHTROOM_CHECK(_first == 0 && _second == 1 && _atlas.build() && _atlas.isBuilt()))
+    {
+        return;
+    }
+    const MipmapMap* _page = &_atlas.getPage(0);
+    AtlasEntry _entry = _atlas.getEntry(_second);
+
+    LIGHTROOM_CHECK(_atlas.add(_image(16, 16, 0xff0000ff)) == TextureAtlas::NO_ENTRY);
+    LIGHTROOM_CHECK(!_atlas.build());
+    LIGHTROOM_CHECK(_atlas.getEntryCount() == 2 && _atlas.getPageCount() == 1 && &_atlas.getPage(0) == _page);
+    LIGHTROOM_CHECK(_atlas.getEntry(_second).origin == _entry.origin && _atlas.getEntry(_second).page == _entry.page);
+    auto& _level = _page->getLevel(0);
+    LIGHTROOM_CHECK(_level.fetch(_entry.origin[0], _entry.origin[1]) == 0xff00ff00);
+}
@@ -0,0 +1,187 @@
+#pragma once
+#include "test_utility.hpp"
+#include "../lrutility.hpp"
+#include <random>
+#include <set>
+
+namespace lightroom::test
+{
+    // Spins until _done holds or the deadline passes, so a broken pool fails instead of hanging
+    template <typename _Done>
+    inline bool spinUntil(_Done&& _done, std::chrono::milliseconds _timeout = std::chrono::milliseconds(10000))
+    {
+        auto _deadline = std::chrono::steady_clock::now() + _timeout;
+        while (!_done())
+        {
+            if (std::chrono::steady_clock::now() > _deadline)
+            {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+}
+
+// Every index exactly once, nested loops included, whatever the grain and thread limit
+LIGHTROOM_TEST(jobSystemParallelForVisitsEachIndexOnce)
+{
+    using namespace lightroom;
+    JobSystem _jobs(4);
+    for (size_t _grain : { 1, 7, 1000 })
+    {
+        for (unsigned _maxThreads : { 0u, 1u, 3u })
+        {
+            std::vector<std::atomic<int>> _hits(64 * 64);
+            _jobs.parallelFor(64, [&](size_t _i)
+            {
+                _jobs.parallelFor(64, [&](size_t _j) { _hits[_i * 64 + _j]++; }, _grain, _maxThreads);
+            }, _grain, _maxThreads);
+            LIGHTROOM_CHECK(std::all_of(_hits.begin(), _hits.end(), [](auto& _h) { return _h == 1; }));
+        }
+    }
+    int _serialHits = 0;
+    JobSystem::getSerial().parallelFor(100, [&](size_t) { _serialHits++; });
+    LIGHTROOM_CHECK(_serialHits == 100);
+}
+
+// A job starts only after all of its dependencies have finished; finished and null
+// dependencies do not hold it back
+LIGHTROOM_TEST(jobSystemRunsDependenciesFirst)
+{
+    using namespace lightroom;
+    JobSystem _jobs(4);
+    for (int _round = 0; _round < 100; _round++)
+    {
+        std::atomic<int> _clock = 0;
+        int _a = -1, _b = -1, _c = -1, _d = -1;
+        auto _ja = _jobs.submit([&] { std::this_thread::sleep_for(std::chrono::microseconds(200)); _a = _clock++; });
+        auto _jb = _jobs.submit([&] { _b = _clock++; }, { _ja });
+        auto _jc = _jobs.submit([&] { _c = _clock++; }, { _ja, nullptr });
+        auto _jd = _jobs.submit([&] { _d = _clock++; }, { _jb, _jc });
+        _jobs.wait(_jd);
+        LIGHTROOM_CHECK(_a == 0 && _b > _a && _c > _a && _d == 3 && _jb->isDone() && _jc->isDone());
+    }
+    bool _ran = false;
+    auto _done = _jobs.submit([] {});
+    _jobs.wait(_done);
+    _jobs.wait(_jobs.submit([&] { _ran = true; }, { _done }));
+    LIGHTROOM_CHECK(_ran);
+
+    // the serial pool runs a job as soon as it is submitted
+    int _order = 0, _first = -1, _second = -1;
+    auto _js = JobSystem::getSerial().submit([&] { _first = _order++; });
+    JobSystem::getSerial().submit([&] { _second = _order++; }, { _js });
+    LIGHTROOM_CHECK(_first == 0 && _second == 1);
+}
+
+// Jobs a busy worker pushes to its own deque are taken by the others: the owner spins without
+// waiting until they are all done, so it never runs them itself
+LIGHTROOM_TEST(jobSystemIdleWorkersSteal)
+{
+    using namespace lightroom;
+    static constexpr int _CHILDREN = 64;
+    JobSystem _jobs(4);
+    std::atomic<int> _finished = 0, _byCaller = 0;
+    std::mutex _mutex;
+    std::set<std::thread::id> _runners;
+    std::thread::id _owner, _caller = std::this_thread::get_id();
+    bool _allRan = false;
+    _jobs.resetStats();
+    _jobs.forEachWorker([&](unsigned _worker)
+    {
+        if (_worker != 0)
+        {
+            return;
+        }
+        _owner = std::this_thread::get_id();
+        for (int _i = 0; _i < _CHILDREN; _i++)
+        {
+            _jobs.submit([&]
+            {
+                {
+                    std::lock_guard<std::mutex> _lock(_mutex);
+                    _runners.insert(std::this_thread::get_id());
+                }
+                _byCaller += std::this_thread::get_id() == _caller;
+                _finished++;
+            });
+        }
+        _allRan = test::spinUntil([&] { return _finished == _CHILDREN; });
+    });
+    LIGHTROOM_CHECK(_allRan && !_runners.count(_owner));
+
+    // children the waiting caller ran are not counted: it is no worker
+    auto _owned = _jobs.getWorkerStats(0);
+    size_t _steals = 0;
+    for (unsigned _w = 1; _w < _jobs.getThreadCount(); _w++)
+    {
+        _steals += _jobs.getWorkerStats(_w).steals;
+    }
+    LIGHTROOM_CHECK(_owned.steals == 0 && _steals + _byCaller >= _CHILDREN);
+}
+
+// forEachWorker calls the body once on each worker, each on its own thread
+LIGHTROOM_TEST(jobSystemForEachWorkerCoversEveryWorker)
+{
+    using namespace lightroom;
+    JobSystem _jobs(4);
+    std::mutex _mutex;
+    std::vector<int> _calls(_jobs.getThreadCount());
+    std::set<std::thread::id> _threads;
+    _jobs.forEachWorker([&](unsigned _worker)
+    {
+        std::lock_guard<std::mutex> _lock(_mutex);
+        _calls[_worker]++;
+        _threads.insert(std::this_thread::get_id());
+    });
+    LIGHTROOM_CHECK(std::all_of(_calls.begin(), _calls.end(), [](int _c) { return _c == 1; }));
+    LIGHTROOM_CHECK(_threads.size() == _jobs.getThreadCount() && !_threads.count(std::this_thread::get_id()));
+}
+
+// A worker stuck in a background job does not hold up forEachWorker: its call runs elsewhere,
+// and the background job sees forEachWorker return before it does
+LIGHTROOM_TEST(jobSystemForEachWorkerPassesBusyWorkers)
+{
+    using namespace lightroom;
+    JobSystem _jobs(2);
+    std::atomic<bool> _started = false, _placed = false;
+    bool _sawPlaced = false;
+    auto _background = _jobs.submitBackground([&]
+    {
+        _started = true;
+        _sawPlaced = test::spinUntil([&] { return _placed.load(); });
+    });
+    LIGHTROOM_CHECK(test::spinUntil([&] { return _started.load(); }));
+    std::vector<std::atomic<int>> _calls(_jobs.getThreadCount());
+    _jobs.forEachWorker([&](unsigned _w) { _calls[_w]++; });
+    _placed = true;
+    _jobs.wait(_background);
+    LIGHTROOM_CHECK(_sawPlaced);
+    LIGHTROOM_CHECK(std::all_of(_calls.begin(), _calls.end(), [](auto& _c) { return _c == 1; }));
+}
+
+// Same order as std::stable_sort, for full 64-bit keys, keys using a few bits and equal keys
+LIGHTROOM_TEST(radixSortMatchesStableSort)
+{
+    using namespace lightroom;
+    using Item = std::pair<uint64_t, int>;
+    std::mt19937_64 _random(1);
+    std::vector<Item> _scratch;
+    for (int _shift : { 0, 40, 60, 64 })
+    {
+        for (size_t _count : { 0, 1, 2, 1000 })
+        {
+            std::vector<Item> _items;
+            for (size_t _i = 0; _i < _count; _i++)
+            {
+                _items.push_back({ _shift == 64 ? 7 : _random() >> _shift, static_cast<int>(_i) });
+            }
+            auto _expected = _items;
+            std::stable_sort(_expected.begin(), _expected.end(),
+                             [](const Item& _a, const Item& _b) { return _a.first < _b.first; });
+            radixSort(_items, _scratch, [](const Item& _item) { return _item.first; });
+            LIGHTROOM_CHECK(_items == _expected);
+        }
+    }
+}
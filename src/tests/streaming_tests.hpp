@@ -0,0 +1,78 @@
+#pragma once
+#include "test_utility.hpp"
+#include "../texture.hpp"
+#include <thread>
+
+namespace lightroom::test
+{
+    // Opens the streamer's and the residency manager's side of a StreamingTexture
+    class StreamingTextureAccess : public StreamingTexture
+    {
+    public:
+        using StreamingTexture::StreamingTexture;
+        using StreamingTexture::_publish;
+        using StreamingTexture::_evict;
+    };
+
+    inline MipLevel makeFlatLevel(const PxCoordinate& _size, Texel _texel)
+    {
+        MipLevel _level(_size);
+        std::fill(_level.texels.begin(), _level.texels.end(), _texel);
+        return _level;
+    }
+}
+
+// One thread streams levels in and evicts them again while another samples eight texels at a
+// time. Evicted levels are kept until the sampler stops, as the residency manager keeps them for
+// frames in flight, so every texel read is either the placeholder or a fully published level.
+LIGHTROOM_TEST(streamingPublishAndEvictRaceSample8)
+{
+    using namespace lightroom;
+    static constexpr int _SIZE = 64;
+    static constexpr size_t _LEVELS = 7;
+    static constexpr int _ROUNDS = 500;
+    static constexpr Texel _PLACEHOLDER = 0xff808080, _TEXEL = 0xff2050c0;
+    test::StreamingTextureAccess _texture({ _SIZE, _SIZE }, _LEVELS, _PLACEHOLDER);
+
+    std::atomic<bool> _done = false;
+    std::atomic<int> _bad = 0;
+    std::thread _sampler([&]
+    {
+        TextureSampler _nearest(TextureFilter::NEAREST);
+        const TextureMap& _map = _texture;
+        float _u[8], _v[8];
+        for (int _i = 0; _i < 8; _i++)
+        {
+            _u[_i] = 0.1f * _i + 0.05f;
+            _v[_i] = 0.9f - 0.1f * _i;
+        }
+        for (size_t _n = 0; !_done.load(std::memory_order_acquire); _n++)
+        {
+            Texel _out[8];
+            _map.sample8(_nearest, _u, _v, static_cast<Float>(_n % _LEVELS), _out);
+            for (auto _texel : _out)
+            {
+                _bad += _texel != _PLACEHOLDER && _texel != _TEXEL;
+            }
+        }
+    });
+
+    std::vector<std::unique_ptr<MipLevel>> _retired;
+    for (int _round = 0; _round < _ROUNDS; _round++)
+    {
+        for (size_t _l = _texture.getResidentLevel(); _l-- > 0;)
+        {
+            _texture._publish(_l, test::makeFlatLevel({ (std::max)(1, _SIZE >> _l), (std::max)(1, _SIZE >> _l) }, _TEXEL));
+        }
+        while (_texture.getResidentLevel() < _LEVELS - 1)
+        {
+            _retired.push_back(_texture._evict());
+        }
+    }
+    _done.store(true, std::memory_order_release);
+    _sampler.join();
+
+    LIGHTROOM_CHECK(_bad == 0);
+    LIGHTROOM_CHECK(_retired.size() == static_cast<size_t>(_ROUNDS) * (_LEVELS - 1));
+    LIGHTROOM_CHECK(_texture.getResidentLevel() == _LEVELS - 1);
+}
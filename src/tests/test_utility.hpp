@@ -0,0 +1,54 @@
+#pragma once
+#ifndef _TEST_UTILITY_
+#define _TEST_UTILITY_
+
+#include <cstdio>
+#include <vector>
+
+// Minimal self-registering tests: LIGHTROOM_TEST(name) { LIGHTROOM_CHECK(...); }.
+// tests.cpp runs every registered test and returns the number of failed checks.
+namespace lightroom::test
+{
+    struct TestCase
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    inline std::vector<TestCase>& getTests()
+    {
+        static std::vector<TestCase> _tests;
+        return _tests;
+    }
+    inline int& getFailures()
+    {
+        static int _failures = 0;
+        return _failures;
+    }
+
+    struct Registration
+    {
+        Registration(const char* _name, void (*_run)())
+        {
+            getTests().push_back({ _name, _run });
+        }
+    };
+
+    inline bool check(bool _passed, const char* _expression, const char* _file, int _line)
+    {
+        if (!_passed)
+        {
+            getFailures()++;
+            std::fprintf(stderr, "%s(%d): check failed: %s\n", _file, _line, _expression);
+        }
+        return _passed;
+    }
+};
+
+#define LIGHTROOM_TEST(_name) \
+    static void _name(); \
+    static const lightroom::test::Registration _name##_registration(#_name, &_name); \
+    static void _name()
+#define LIGHTROOM_CHECK(_expression) lightroom::test::check(static_cast<bool>(_expression), #_expression, __FILE__, __LINE__)
+
+#endif // !_TEST_UTILITY_
@@ -0,0 +1,21 @@
+// Test runner: every LIGHTROOM_TEST of the headers below, in order of registration.
+// Exits with the number of failed checks, so a build step or script can gate on it.
+
+#include "test_utility.hpp"
+#include "atlas_tests.hpp"
+#include "decoder_tests.hpp"
+#include "job_system_tests.hpp"
+#include "streaming_tests.hpp"
+
+int main()
+{
+    using namespace lightroom::test;
+    for (auto& _test : getTests())
+    {
+        int _before = getFailures();
+        _test.run();
+        std::printf("%-48s %s\n", _test.name, getFailures() == _before ? "ok" : "FAILED");
+    }
+    std::printf("%zu tests, %d failed checks\n", getTests().size(), getFailures());
+    return getFailures();
+}
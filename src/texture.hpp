@@ -0,0 +1,16 @@
+#pragma once
+#ifndef _TEXTURE_
+#define _TEXTURE_
+
+#include "texture/mipmap.hpp"
+#include "texture/sampler.hpp"
+#include "texture/block_compression.hpp"
+#include "texture/texture_file.hpp"
+#include "texture/image_file.hpp"
+#include "texture/image_loader.hpp"
+#include "texture/streaming.hpp"
+#include "texture/residency.hpp"
+#include "texture/atlas.hpp"
+#include "texture/procedural.hpp"
+
+#endif // !_TEXTURE_
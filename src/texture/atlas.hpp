@@ -0,0 +1,222 @@
+#pragma once
+#include "mipmap.hpp"
+
+namespace lightroom
+{
+    // Where one packed image ended up: uv * uvScale + uvOffset maps the image's own [0, 1]
+    // coordinates into its page
+    struct AtlasEntry
+    {
+        size_t page = 0;
+        PxCoordinate origin{ 0, 0 };
+        PxCoordinate size{ 0, 0 };
+        UVCoordinate uvScale{ 1, 1 };
+        UVCoordinate uvOffset{ 0, 0 };
+
+        inline UVCoordinate remap(const UVCoordinate& _uv) const
+        {
+            return _uv.cwiseProduct(uvScale) + uvOffset;
+        }
+    };
+
+    // Packs many small images into shared pages with shelf packing, tallest first.
+    // Every image sits on a 2^padLevels grid inside a gutter of 2^padLevels replicated edge
+    // texels, and pages keep only padLevels + 1 mip levels, so no level bleeds a neighbour
+    // into a bilinear footprint. Material::fromAtlas clamps UVs to each entry's own rectangle;
+    // atlased images cannot WRAP. An atlas is built once: its pages never move afterwards, so
+    // materials may keep pointing into them.
+    class TextureAtlas
+    {
+    public:
+        static constexpr size_t NO_ENTRY = SIZE_MAX;
+
+    protected:
+        PxCoordinate _pageSize;
+        int _padLevels;
+        std::vector<std::unique_ptr<DecodedImage>> _staged;
+        std::vector<AtlasEntry> _entries;
+        std::vector<std::unique_ptr<MipmapMap>> _pages;
+        bool _built = false;
+
+    public:
+        TextureAtlas(const PxCoordinate& _pageSize = { 2048, 2048 }, int _padLevels = 2) :
+            _pageSize(_pageSize), _padLevels(_padLevels) {}
+
+        // Stages an image and returns its entry index; entries are valid after build().
+        // NO_ENTRY once the atlas is built.
+        size_t add(const ColorMap& _image)
+        {
+            auto _copy = std::make_unique<DecodedImage>(PxCoordinate{ _image.getWidth(), _image.getHeight() });
+            for (int _y = 0; _y < _copy->getHeight(); _y++)
+            {
+                auto _row = _copy->getRow(_y);
+                for (int _x = 0; _x < _copy->getWidth(); _x++)
+                {
+                    _row[_x] = packTexel(_image.get(static_cast<size_t>(_y) * _copy->getWidth() + _x));
+                }
+            }
+            return add(std::move(_copy));
+        }
+        size_t add(std::unique_ptr<DecodedImage>&& _image)
+        {
+            if (_built)
+            {
+                return NO_ENTRY;
+            }
+            _staged.push_back(std::move(_image));
+            _entries.emplace_back();
+            return _entries.size() - 1;
+        }
+
+        // Packs everything staged into pages and releases the staged copies. False if the atlas
+        // is already built, or if some image does not fit a page even on its own.
+        bool build()
+        {
+            if (_built)
+            {
+                return false;
+            }
+            int _align = 1 << _padLevels;
+            std::vector<size_t> _order(_staged.size());
+            for (size_t _i = 0; _i < _order.size(); _i++)
+            {
+                _order[_i] = _i;
+                auto _cell = _cellSize({ _staged[_i]->getWidth(), _staged[_i]->getHeight() });
+                if (_cell[0] > _pageSize[0] || _cell[1] > _pageSize[1])
+                {
+                    return false;
+                }
+            }
+            std::stable_sort(_order.begin(), _order.end(), [this](size_t _a, size_t _b)
+                             {
+                                 return _staged[_a]->getHeight() > _staged[_b]->getHeight();
+                             });
+
+            std::vector<int> _pageHeights;
+            int _x = 0, _shelfY = 0, _shelfHeight = 0;
+            for (auto _i : _order)
+            {
+                auto _cell = _cellSize({ _staged[_i]->getWidth(), _staged[_i]->getHeight() });
+                if (_x + _cell[0] > _pageSize[0])
+                {
+                    _x = 0;
+                    _shelfY += _shelfHeight;
+                    _shelfHeight = 0;
+                }
+                if (_pageHeights.empty() || _shelfY + _cell[1] > _pageSize[1])
+                {
+                    _pageHeights.push_back(0);
+                    _x = _shelfY = _shelfHeight = 0;
+                }
+                auto& _entry = _entries[_i];
+                _entry.page = _pageHeights.size() - 1;
+                _entry.origin = { _x + _align, _shelfY + _align };
+                _entry.size = { _staged[_i]->getWidth(), _staged[_i]->getHeight() };
+                _x += _cell[0];
+                _shelfHeight = max(_shelfHeight, _cell[1]);
+                _pageHeights.back() = max(_pageHeights.back(), _shelfY + _shelfHeight);
+            }
+
+            // pages are trimmed to their last shelf
+            std::vector<MipLevel> _bases;
+            for (auto _height : _pageHeights)
+            {
+                _bases.emplace_back(PxCoordinate{ _pageSize[0], _height });
+            }
+            for (size_t _i = 0; _i < _entries.size(); _i++)
+            {
+                auto& _entry = _entries[_i];
+                auto& _base = _bases[_entry.page];
+                _blit(*_staged[_i], _base, _entry.origin, _cellSize(_entry.size));
+                _entry.uvScale = { Float(_entry.size[0]) / _base.size[0], Float(_entry.size[1]) / _base.size[1] };
+                _entry.uvOffset = { Float(_entry.origin[0]) / _base.size[0], Float(_entry.origin[1]) / _base.size[1] };
+            }
+            for (auto& _base : _bases)
+            {
+                _pages.push_back(std::make_unique<MipmapMap>(std::move(_base), _padLevels + 1));
+            }
+            _staged.clear();
+            _built = true;
+            return true;
+        }
+
+        inline bool isBuilt() const
+        {
+            return _built;
+        }
+
+        inline size_t getEntryCount() const
+        {
+            return _entries.size();
+        }
+        inline const AtlasEntry& getEntry(size_t _index) const
+        {
+            return _entries[_index];
+        }
+        inline size_t getPageCount() const
+        {
+            return _pages.size();
+        }
+        inline const MipmapMap& getPage(size_t _page) const
+        {
+            return *_pages[_page];
+        }
+        inline int getPadLevels() const
+        {
+            return _padLevels;
+        }
+
+        // One line per entry: page, origin, size, uv scale and offset
+        bool saveManifest(const std::filesystem::path& _fileName) const
+        {
+            std::ofstream _file(_fileName);
+            _file.precision(9);
+            for (auto& _e : _entries)
+            {
+                _file << _e.page << ' ' << _e.origin[0] << ' ' << _e.origin[1] << ' '
+                    << _e.size[0] << ' ' << _e.size[1] << ' '
+                    << _e.uvScale[0] << ' ' << _e.uvScale[1] << ' '
+                    << _e.uvOffset[0] << ' ' << _e.uvOffset[1] << '\n';
+            }
+            return static_cast<bool>(_file);
+        }
+        static std::vector<AtlasEntry> loadManifest(const std::filesystem::path& _fileName)
+        {
+            std::vector<AtlasEntry> _entries;
+            std::ifstream _file(_fileName);
+            for (AtlasEntry _e; _file >> _e.page >> _e.origin[0] >> _e.origin[1] >> _e.size[0] >> _e.size[1] >>
+                 _e.uvScale[0] >> _e.uvScale[1] >> _e.uvOffset[0] >> _e.uvOffset[1];)
+            {
+                _entries.push_back(_e);
+            }
+            return _entries;
+        }
+
+    protected:
+        // Image plus gutter on both sides, rounded up to the alignment grid
+        inline PxCoordinate _cellSize(const PxCoordinate& _size) const
+        {
+            int _align = 1 << _padLevels;
+            return { ((_size[0] + _align - 1) & ~(_align - 1)) + 2 * _align,
+                     ((_size[1] + _align - 1) & ~(_align - 1)) + 2 * _align };
+        }
+
+        // Copies the image and replicates its edges over the whole cell around it
+        inline void _blit(const DecodedImage& _image, MipLevel& _page, const PxCoordinate& _origin,
+                          const PxCoordinate& _cell) const
+        {
+            int _align = 1 << _padLevels;
+            int _left = _origin[0] - _align, _top = _origin[1] - _align;
+            for (int _y = 0; _y < _cell[1]; _y++)
+            {
+                int _sy = min(max(_y - _align, 0), _image.getHeight() - 1);
+                auto _row = _image.getRow(_sy);
+                for (int _x = 0; _x < _cell[0]; _x++)
+                {
+                    int _sx = min(max(_x - _align, 0), _image.getWidth() - 1);
+                    _page.store(_left + _x, _top + _y, _row[_sx]);
+                }
+            }
+        }
+    };
+};
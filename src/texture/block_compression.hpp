@@ -0,0 +1,414 @@
+#pragma once
+#include "mipmap.hpp"
+
+namespace lightroom
+{
+    // BC1: opaque RGB 5:6:5 endpoints, 8 bytes per 4x4 block (0.5 byte per texel).
+    // BC3: BC1 colour plus an interpolated 8-bit alpha block, 16 bytes per 4x4 block.
+    enum class BlockFormat : uint8_t
+    {
+        BC1, BC3
+    };
+
+    inline constexpr size_t blockBytes(BlockFormat _format)
+    {
+        return _format == BlockFormat::BC1 ? 8 : 16;
+    }
+
+    class BlockCodec
+    {
+    public:
+        static inline void encode(BlockFormat _format, const Texel (&_texels)[16], uint8_t* _out)
+        {
+            if (_format == BlockFormat::BC3)
+            {
+                _encodeAlpha(_texels, _out);
+                _encodeColor(_texels, _out + 8);
+            }
+            else
+            {
+                _encodeColor(_texels, _out);
+            }
+        }
+        static inline void decode(BlockFormat _format, const uint8_t* _block, Texel (&_texels)[16])
+        {
+            if (_format == BlockFormat::BC3)
+            {
+                _decodeColor(_block + 8, _texels, true);
+                _decodeAlpha(_block, _texels);
+            }
+            else
+            {
+                _decodeColor(_block, _texels, false);
+            }
+        }
+
+    private:
+        static inline uint16_t _to565(int _r, int _g, int _b)
+        {
+            return static_cast<uint16_t>(((_r >> 3) << 11) | ((_g >> 2) << 5) | (_b >> 3));
+        }
+        static inline void _from565(uint16_t _c, int (&_rgb)[3])
+        {
+            int _r = (_c >> 11) & 31, _g = (_c >> 5) & 63, _b = _c & 31;
+            _rgb[0] = (_r << 3) | (_r >> 2);
+            _rgb[1] = (_g << 2) | (_g >> 4);
+            _rgb[2] = (_b << 3) | (_b >> 2);
+        }
+
+        // Bounding-box endpoints inset by 1/16 of the range, then nearest palette entry per texel
+        static inline void _encodeColor(const Texel (&_texels)[16], uint8_t* _out)
+        {
+            int _lo[3]{ 255, 255, 255 }, _hi[3]{ 0, 0, 0 };
+            for (auto _t : _texels)
+            {
+                for (int _c = 0; _c < 3; _c++)
+                {
+                    int _v = (_t >> (16 - 8 * _c)) & 0xff;
+                    _lo[_c] = min(_lo[_c], _v);
+                    _hi[_c] = max(_hi[_c], _v);
+                }
+            }
+            for (int _c = 0; _c < 3; _c++)
+            {
+                int _inset = (_hi[_c] - _lo[_c]) >> 4;
+                _lo[_c] += _inset;
+                _hi[_c] -= _inset;
+            }
+            uint16_t _c0 = _to565(_hi[0], _hi[1], _hi[2]);
+            uint16_t _c1 = _to565(_lo[0], _lo[1], _lo[2]);
+            if (_c0 < _c1)
+            {
+                std::swap(_c0, _c1);
+            }
+
+            uint32_t _indices = 0;
+            if (_c0 != _c1)
+            {
+                int _palette[4][3];
+                _from565(_c0, _palette[0]);
+                _from565(_c1, _palette[1]);
+                for (int _c = 0; _c < 3; _c++)
+                {
+                    _palette[2][_c] = (2 * _palette[0][_c] + _palette[1][_c]) / 3;
+                    _palette[3][_c] = (_palette[0][_c] + 2 * _palette[1][_c]) / 3;
+                }
+                for (int _i = 0; _i < 16; _i++)
+                {
+                    int _best = 0, _bestError = INT_MAX;
+                    for (int _p = 0; _p < 4; _p++)
+                    {
+                        int _error = 0;
+                        for (int _c = 0; _c < 3; _c++)
+                        {
+                            int _d = static_cast<int>((_texels[_i] >> (16 - 8 * _c)) & 0xff) - _palette[_p][_c];
+                            _error += _d * _d;
+                        }
+                        if (_error < _bestError)
+                        {
+                            _best = _p;
+                            _bestError = _error;
+                        }
+                    }
+                    _indices |= static_cast<uint32_t>(_best) << (2 * _i);
+                }
+            }
+            _out[0] = static_cast<uint8_t>(_c0);
+            _out[1] = static_cast<uint8_t>(_c0 >> 8);
+            _out[2] = static_cast<uint8_t>(_c1);
+            _out[3] = static_cast<uint8_t>(_c1 >> 8);
+            for (int _i = 0; _i < 4; _i++)
+            {
+                _out[4 + _i] = static_cast<uint8_t>(_indices >> (8 * _i));
+            }
+        }
+        static inline void _decodeColor(const uint8_t* _block, Texel (&_texels)[16], bool _forceOpaque)
+        {
+            uint16_t _c0 = static_cast<uint16_t>(_block[0] | (_block[1] << 8));
+            uint16_t _c1 = static_cast<uint16_t>(_block[2] | (_block[3] << 8));
+            int _rgb[4][3];
+            _from565(_c0, _rgb[0]);
+            _from565(_c1, _rgb[1]);
+            Texel _palette[4];
+            bool _fourColor = _forceOpaque || _c0 > _c1;
+            for (int _c = 0; _c < 3; _c++)
+            {
+                if (_fourColor)
+                {
+                    _rgb[2][_c] = (2 * _rgb[0][_c] + _rgb[1][_c]) / 3;
+                    _rgb[3][_c] = (_rgb[0][_c] + 2 * _rgb[1][_c]) / 3;
+                }
+                else
+                {
+                    _rgb[2][_c] = (_rgb[0][_c] + _rgb[1][_c]) / 2;
+                    _rgb[3][_c] = 0;
+                }
+            }
+            for (int _p = 0; _p < 4; _p++)
+            {
+                _palette[_p] = 0xff000000u | (_rgb[_p][0] << 16) | (_rgb[_p][1] << 8) | _rgb[_p][2];
+            }
+            if (!_fourColor)
+            {
+                _palette[3] = 0;
+            }
+            uint32_t _indices = _block[4] | (_block[5] << 8) | (_block[6] << 16) | (static_cast<uint32_t>(_block[7]) << 24);
+            for (int _i = 0; _i < 16; _i++)
+            {
+                _texels[_i] = _palette[(_indices >> (2 * _i)) & 3];
+            }
+        }
+
+        static inline void _alphaPalette(int _a0, int _a1, int (&_palette)[8])
+        {
+            _palette[0] = _a0;
+            _palette[1] = _a1;
+            if (_a0 > _a1)
+            {
+                for (int _i = 1; _i < 7; _i++)
+                {
+                    _palette[_i + 1] = ((7 - _i) * _a0 + _i * _a1) / 7;
+                }
+            }
+            else
+            {
+                for (int _i = 1; _i < 5; _i++)
+                {
+                    _palette[_i + 1] = ((5 - _i) * _a0 + _i * _a1) / 5;
+                }
+                _palette[6] = 0;
+                _palette[7] = 255;
+            }
+        }
+        static inline void _encodeAlpha(const Texel (&_texels)[16], uint8_t* _out)
+        {
+            int _lo = 255, _hi = 0;
+            for (auto _t : _texels)
+            {
+                int _a = _t >> 24;
+                _lo = min(_lo, _a);
+                _hi = max(_hi, _a);
+            }
+            int _palette[8];
+            _alphaPalette(_hi, _lo, _palette);
+
+            uint64_t _indices = 0;
+            for (int _i = 0; _i < 16; _i++)
+            {
+                int _a = _texels[_i] >> 24;
+                int _best = 0, _bestError = INT_MAX;
+                for (int _p = 0; _p < 8; _p++)
+                {
+                    int _error = std::abs(_a - _palette[_p]);
+                    if (_error < _bestError)
+                    {
+                        _best = _p;
+                        _bestError = _error;
+                    }
+                }
+                _indices |= static_cast<uint64_t>(_best) << (3 * _i);
+            }
+            _out[0] = static_cast<uint8_t>(_hi);
+            _out[1] = static_cast<uint8_t>(_lo);
+            for (int _i = 0; _i < 6; _i++)
+            {
+                _out[2 + _i] = static_cast<uint8_t>(_indices >> (8 * _i));
+            }
+        }
+        static inline void _decodeAlpha(const uint8_t* _block, Texel (&_texels)[16])
+        {
+            int _palette[8];
+            _alphaPalette(_block[0], _block[1], _palette);
+            uint64_t _indices = 0;
+            for (int _i = 0; _i < 6; _i++)
+            {
+                _indices |= static_cast<uint64_t>(_block[2 + _i]) << (8 * _i);
+            }
+            for (int _i = 0; _i < 16; _i++)
+            {
+                _texels[_i] = (_texels[_i] & 0x00ffffffu) |
+                    (static_cast<Texel>(_palette[(_indices >> (3 * _i)) & 7]) << 24);
+            }
+        }
+    };
+
+    // Small direct-mapped cache of decoded blocks, one per thread
+    struct DecodedBlockCache
+    {
+        static constexpr size_t ENTRIES = 32;
+        struct Entry
+        {
+            uint32_t id = UINT32_MAX;
+            size_t block = 0;
+            Texel texels[16];
+        } entries[ENTRIES];
+    };
+
+    // Unique key for a block payload in the decoded block cache
+    inline uint32_t newBlockPayloadId()
+    {
+        static std::atomic<uint32_t> _nextId = 0;
+        return _nextId++;
+    }
+
+    // Fetches one texel from row-major 4x4 blocks, decoding the whole block into
+    // a direct-mapped cache private to the calling thread
+    inline Texel fetchBlockTexel(BlockFormat _format, const uint8_t* _blocks, int _blocksX, uint32_t _id,
+                                 int _x, int _y)
+    {
+        static thread_local DecodedBlockCache _cache;
+        size_t _block = static_cast<size_t>(_y >> 2) * _blocksX + (_x >> 2);
+        auto& _entry = _cache.entries[(_block ^ (static_cast<size_t>(_id) * 7)) & (DecodedBlockCache::ENTRIES - 1)];
+        if (_entry.id != _id || _entry.block != _block)
+        {
+            BlockCodec::decode(_format, _blocks + _block * blockBytes(_format), _entry.texels);
+            _entry.id = _id;
+            _entry.block = _block;
+        }
+        return _entry.texels[((_y & 3) << 2) | (_x & 3)];
+    }
+
+    struct CompressedMipLevel
+    {
+        PxCoordinate size;
+        BlockFormat format;
+        int blocksX;
+        std::vector<uint8_t> blocks;
+        uint32_t id;
+
+        CompressedMipLevel(const PxCoordinate& size = { 0, 0 }, BlockFormat format = BlockFormat::BC1) :
+            size(size), format(format), blocksX((size[0] + 3) / 4),
+            blocks(static_cast<size_t>(blocksX) * ((size[1] + 3) / 4) * blockBytes(format)),
+            id(newBlockPayloadId()) {}
+
+        inline Texel fetch(int _x, int _y) const
+        {
+            return fetchBlockTexel(format, blocks.data(), blocksX, id, _x, _y);
+        }
+    };
+
+    class BlockCompressedMap : public TextureMapBase<BlockCompressedMap>
+    {
+    protected:
+        BlockFormat _format;
+        std::vector<CompressedMipLevel> _levels;
+
+    public:
+        BlockCompressedMap(const MipmapMap& _source, BlockFormat _format) :
+            TextureMapBase({ _source.getWidth(), _source.getHeight() }), _format(_format)
+        {
+            for (size_t _l = 0; _l < _source.getLevelCount(); _l++)
+            {
+                auto& _src = _source.getLevel(_l);
+                CompressedMipLevel _dst(_src.size, _format);
+                for (int _by = 0; _by * 4 < _src.size[1]; _by++)
+                {
+                    for (int _bx = 0; _bx * 4 < _src.size[0]; _bx++)
+                    {
+                        Texel _texels[16];
+                        for (int _i = 0; _i < 16; _i++)
+                        {
+                            _texels[_i] = _src.fetch(min(_bx * 4 + (_i & 3), _src.size[0] - 1),
+                                                     min(_by * 4 + (_i >> 2), _src.size[1] - 1));
+                        }
+                        BlockCodec::encode(_format, _texels,
+                                           &_dst.blocks[(static_cast<size_t>(_by) * _dst.blocksX + _bx) * blockBytes(_format)]);
+                    }
+                }
+                _levels.push_back(std::move(_dst));
+            }
+        }
+        BlockCompressedMap(const ColorMap& _source, BlockFormat _format) :
+            BlockCompressedMap(MipmapMap(_source), _format) {}
+        BlockCompressedMap(BlockFormat _format, std::vector<CompressedMipLevel>&& _levels) :
+            TextureMapBase(_levels.front().size), _format(_format), _levels(std::move(_levels)) {}
+        virtual ~BlockCompressedMap() {}
+
+        virtual Color get(size_t _index) const override
+        {
+            return unpackTexel(_levels[0].fetch(static_cast<int>(_index % _size[0]),
+                                                static_cast<int>(_index / _size[0])));
+        }
+
+        inline BlockFormat getFormat() const
+        {
+            return _format;
+        }
+        inline size_t getLevelCount() const
+        {
+            return _levels.size();
+        }
+        inline const CompressedMipLevel& getLevel(size_t _level) const
+        {
+            return _levels[_level];
+        }
+        inline size_t getByteSize() const
+        {
+            size_t _bytes = 0;
+            for (auto& _level : _levels)
+            {
+                _bytes += _level.blocks.size();
+            }
+            return _bytes;
+        }
+
+        // Raw container: "LRBC", format, width, height, level count, then each level's blocks
+        bool save(const std::filesystem::path& _fileName) const
+        {
+            std::ofstream _file(_fileName, std::ios::binary);
+            uint32_t _header[5]{ 0x4342524c, static_cast<uint32_t>(_format),
+                static_cast<uint32_t>(_size[0]), static_cast<uint32_t>(_size[1]),
+                static_cast<uint32_t>(_levels.size()) };
+            _file.write(reinterpret_cast<const char*>(_header), sizeof(_header));
+            for (auto& _level : _levels)
+            {
+                _file.write(reinterpret_cast<const char*>(_level.blocks.data()), _level.blocks.size());
+            }
+            return _file.good();
+        }
+        static std::unique_ptr<BlockCompressedMap> load(const std::filesystem::path& _fileName)
+        {
+            std::ifstream _file(_fileName, std::ios::binary);
+            uint32_t _header[5]{};
+            if (!_file.read(reinterpret_cast<char*>(_header), sizeof(_header)) || _header[0] != 0x4342524c ||
+                _header[1] > static_cast<uint32_t>(BlockFormat::BC3) || _header[4] == 0)
+            {
+                return nullptr;
+            }
+            auto _format = static_cast<BlockFormat>(_header[1]);
+            // the header is checked against the file before anything is allocated for it
+            if (_header[2] == 0 || _header[3] == 0 || _header[2] > INT_MAX - 3 || _header[3] > INT_MAX - 3 ||
+                _header[4] > 32)
+            {
+                return nullptr;
+            }
+            std::error_code _error;
+            uint64_t _fileSize = std::filesystem::file_size(_fileName, _error);
+            uint64_t _expected = sizeof(_header);
+            for (uint64_t _l = 0, _w = _header[2], _h = _header[3]; _l < _header[4]; _l++)
+            {
+                _expected += ((_w + 3) / 4) * ((_h + 3) / 4) * blockBytes(_format);
+                _w = max(uint64_t(1), _w / 2);
+                _h = max(uint64_t(1), _h / 2);
+            }
+            if (_error || _expected > _fileSize)
+            {
+                return nullptr;
+            }
+            std::vector<CompressedMipLevel> _levels;
+            int _w = static_cast<int>(_header[2]), _h = static_cast<int>(_header[3]);
+            for (uint32_t _l = 0; _l < _header[4]; _l++)
+            {
+                CompressedMipLevel _level(PxCoordinate{ _w, _h }, _format);
+                if (!_file.read(reinterpret_cast<char*>(_level.blocks.data()), _level.blocks.size()))
+                {
+                    return nullptr;
+                }
+                _levels.push_back(std::move(_level));
+                _w = max(1, _w / 2);
+                _h = max(1, _h / 2);
+            }
+            return std::make_unique<BlockCompressedMap>(_format, std::move(_levels));
+        }
+    };
+};
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef _IMAGE_CODEC_
+#define _IMAGE_CODEC_
+
+// Standard library only: the PNG/JPEG/DEFLATE decoders build on any platform, without EasyX
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace lightroom
+{
+    // Packed 0xAARRGGBB texel. Colour channels use the same 1/256 scale as Color(COLORREF),
+    // alpha uses 1/255 so that opaque texels stay exactly opaque.
+    using Texel = uint32_t;
+
+    // Spreads _body(i) for every i in [0, _count) over whatever threads the caller owns;
+    // decoders given an empty one run serially
+    using ParallelFor = std::function<void(size_t _count, const std::function<void(size_t)>& _body)>;
+
+    inline void runParallel(const ParallelFor& _parallelFor, size_t _count, const std::function<void(size_t)>& _body)
+    {
+        if (_parallelFor)
+        {
+            _parallelFor(_count, _body);
+            return;
+        }
+        for (size_t _i = 0; _i < _count; _i++)
+        {
+            _body(_i);
+        }
+    }
+
+    // Row-major decoder output, before it is wrapped for drawing or tiled for sampling
+    struct TexelImage
+    {
+        int width, height;
+        std::vector<Texel> texels;
+
+        TexelImage(int width, int height) :
+            width(width), height(height), texels(static_cast<size_t>(width) * height) {}
+
+        inline Texel* getRow(int _y)
+        {
+            return texels.data() + static_cast<size_t>(_y) * width;
+        }
+        inline const Texel* getRow(int _y) const
+        {
+            return texels.data() + static_cast<size_t>(_y) * width;
+        }
+    };
+};
+
+#endif // !_IMAGE_CODEC_
@@ -0,0 +1,72 @@
+#pragma once
+#include "png_decoder.hpp"
+#include "jpeg_decoder.hpp"
+#include <filesystem>
+#include <fstream>
+
+namespace lightroom
+{
+    // Standard library only, like the decoders: PNG/JPEG files read with std::ifstream and decoded
+    // to row-major texels. Baseline JPEG only; progressive, arithmetic-coded and CMYK files, like
+    // anything else the decoders reject, come back as nullptr.
+
+    // Reads at most _limit bytes (the whole file by default); false if it cannot be opened
+    inline bool readImageFile(const std::filesystem::path& _fileName, std::vector<uint8_t>& _bytes, size_t _limit = SIZE_MAX)
+    {
+        std::ifstream _file(_fileName, std::ios::binary | std::ios::ate);
+        if (!_file)
+        {
+            return false;
+        }
+        std::streamoff _end = _file.tellg();
+        if (_end < 0)
+        {
+            return false;
+        }
+        _bytes.resize((std::min)(static_cast<size_t>(_end), _limit));
+        _file.seekg(0);
+        return _bytes.empty() || _file.read(reinterpret_cast<char*>(_bytes.data()), _bytes.size());
+    }
+
+    inline bool probeImage(const uint8_t* _data, size_t _size, int& _width, int& _height)
+    {
+        return PngDecoder::probe(_data, _size, _width, _height) || JpegDecoder::probe(_data, _size, _width, _height);
+    }
+
+    inline std::unique_ptr<TexelImage> decodeImage(const uint8_t* _data, size_t _size, const ParallelFor& _parallelFor = nullptr)
+    {
+        if (PngDecoder::matches(_data, _size))
+        {
+            return PngDecoder::decode(_data, _size, _parallelFor);
+        }
+        if (JpegDecoder::matches(_data, _size))
+        {
+            return JpegDecoder::decode(_data, _size, _parallelFor);
+        }
+        return nullptr;
+    }
+
+    // Reads only as much as the header needs: the first 64 KiB, and the rest only for a JPEG
+    // whose frame header sits behind large metadata segments
+    inline bool probeImageFile(const std::filesystem::path& _fileName, int& _width, int& _height)
+    {
+        static constexpr size_t _HEAD = 64 * 1024;
+        std::vector<uint8_t> _bytes;
+        if (!readImageFile(_fileName, _bytes, _HEAD))
+        {
+            return false;
+        }
+        if (probeImage(_bytes.data(), _bytes.size(), _width, _height))
+        {
+            return true;
+        }
+        return _bytes.size() == _HEAD && JpegDecoder::matches(_bytes.data(), _bytes.size()) &&
+               readImageFile(_fileName, _bytes) && probeImage(_bytes.data(), _bytes.size(), _width, _height);
+    }
+
+    inline std::unique_ptr<TexelImage> loadImageFile(const std::filesystem::path& _fileName, const ParallelFor& _parallelFor = nullptr)
+    {
+        std::vector<uint8_t> _bytes;
+        return readImageFile(_fileName, _bytes) ? decodeImage(_bytes.data(), _bytes.size(), _parallelFor) : nullptr;
+    }
+};
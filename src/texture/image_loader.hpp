@@ -0,0 +1,62 @@
+#pragma once
+#include "image_file.hpp"
+#include "texture_utility.hpp"
+
+namespace lightroom
+{
+    // Renderer-side PNG/JPEG loading: image_file.hpp reads and decodes the file, the job system
+    // spreads the rows, and the result is wrapped as a ColorMap at the image's own size.
+    // Progressive JPEGs and any other file the decoders reject load as nullptr.
+    class ImageLoader
+    {
+    protected:
+        unsigned _threadCount;
+
+    public:
+        ImageLoader(unsigned _threadCount = 0) :
+            _threadCount(_threadCount ? _threadCount : (std::max)(1u, std::thread::hardware_concurrency())) {}
+
+        // Decodes one image, spreading its rows over the loader's threads; nullptr on failure,
+        // including for progressive JPEGs
+        inline std::unique_ptr<DecodedImage> load(const std::filesystem::path& _fileName) const
+        {
+            return _load(_fileName, _threadCount);
+        }
+        inline std::unique_ptr<DecodedImage> decode(const uint8_t* _data, size_t _size) const
+        {
+            return _decode(_data, _size, _threadCount);
+        }
+
+        // Reads only the header; false if the file is not a PNG or JPEG
+        inline static bool probe(const std::filesystem::path& _fileName, PxCoordinate& _dimensions)
+        {
+            return probeImageFile(_fileName, _dimensions[0], _dimensions[1]);
+        }
+
+        // Decodes a whole library at once, one image per thread; failed entries are nullptr
+        std::vector<std::unique_ptr<DecodedImage>> loadAll(const std::vector<std::filesystem::path>& _fileNames) const
+        {
+            std::vector<std::unique_ptr<DecodedImage>> _images(_fileNames.size());
+            parallelFor(_fileNames.size(), _threadCount,
+                        [&](size_t _i)
+                        {
+                            _images[_i] = _load(_fileNames[_i], 1);
+                        });
+            return _images;
+        }
+
+    protected:
+        inline static std::unique_ptr<DecodedImage> _load(const std::filesystem::path& _fileName, unsigned _threads)
+        {
+            return _wrap(loadImageFile(_fileName, makeParallelFor(_threads)));
+        }
+        inline static std::unique_ptr<DecodedImage> _decode(const uint8_t* _data, size_t _size, unsigned _threads)
+        {
+            return _wrap(decodeImage(_data, _size, makeParallelFor(_threads)));
+        }
+        inline static std::unique_ptr<DecodedImage> _wrap(std::unique_ptr<TexelImage>&& _image)
+        {
+            return _image ? std::make_unique<DecodedImage>(std::move(*_image)) : nullptr;
+        }
+    };
+};
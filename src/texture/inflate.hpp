@@ -0,0 +1,314 @@
+#pragma once
+#include "image_codec.hpp"
+
+namespace lightroom
+{
+    // DEFLATE (RFC 1951) decoder for zlib streams embedded in PNG files
+    class Inflater
+    {
+    protected:
+        // Canonical Huffman code with a direct lookup for short codes
+        struct HuffmanTable
+        {
+            static constexpr int FAST_BITS = 10;
+
+            uint16_t fast[1 << FAST_BITS];  // symbol | length << 9, zero when the code is longer
+            uint16_t counts[16];
+            uint16_t symbols[288];
+
+            bool build(const uint8_t* _lengths, int _count)
+            {
+                memset(counts, 0, sizeof(counts));
+                for (int _i = 0; _i < _count; _i++)
+                {
+                    counts[_lengths[_i]]++;
+                }
+                counts[0] = 0;
+                int _left = 1;
+                for (int _len = 1; _len < 16; _len++)
+                {
+                    _left = (_left << 1) - counts[_len];
+                    if (_left < 0)
+                    {
+                        return false;
+                    }
+                }
+
+                uint16_t _offsets[16]{}, _next[16]{};
+                for (int _len = 1, _code = 0; _len < 16; _len++)
+                {
+                    _offsets[_len] = _len > 1 ? _offsets[_len - 1] + counts[_len - 1] : 0;
+                    _code = (_code + counts[_len - 1]) << 1;
+                    _next[_len] = static_cast<uint16_t>(_code);
+                }
+                memset(fast, 0, sizeof(fast));
+                for (int _i = 0; _i < _count; _i++)
+                {
+                    int _len = _lengths[_i];
+                    if (!_len)
+                    {
+                        continue;
+                    }
+                    symbols[_offsets[_len]++] = static_cast<uint16_t>(_i);
+                    int _code = _next[_len]++;
+                    if (_len <= FAST_BITS)
+                    {
+                        // codes are stored most significant bit first in an LSB-first stream
+                        int _reversed = 0;
+                        for (int _b = 0; _b < _len; _b++)
+                        {
+                            _reversed |= ((_code >> _b) & 1) << (_len - 1 - _b);
+                        }
+                        for (int _r = _reversed; _r < (1 << FAST_BITS); _r += 1 << _len)
+                        {
+                            fast[_r] = static_cast<uint16_t>(_i | (_len << 9));
+                        }
+                    }
+                }
+                return true;
+            }
+        };
+
+        const uint8_t* _data;
+        size_t _size;
+        size_t _pos = 0;
+        uint64_t _bits = 0;
+        int _count = 0;
+        std::vector<uint8_t>& _out;
+        size_t _limit;
+
+        Inflater(const uint8_t* _data, size_t _size, std::vector<uint8_t>& _out, size_t _maxOutput) :
+            _data(_data), _size(_size), _out(_out), _limit(_out.size() + _maxOutput) {}
+
+    public:
+        // Output beyond this is treated as corrupt unless the caller passes a tighter bound
+        static constexpr size_t DEFAULT_MAX_OUTPUT = size_t(1) << 30;
+
+        // Decompresses a zlib-wrapped stream, appending at most _maxOutput bytes to _out;
+        // false on corrupt input or when the stream would produce more
+        static bool zlib(const uint8_t* _data, size_t _size, std::vector<uint8_t>& _out,
+                         size_t _maxOutput = DEFAULT_MAX_OUTPUT)
+        {
+            if (_size < 2 || (_data[0] & 0x0f) != 8 || ((_data[0] << 8) | _data[1]) % 31 || (_data[1] & 0x20))
+            {
+                return false;
+            }
+            return Inflater(_data + 2, _size - 2, _out, _maxOutput)._inflate();
+        }
+        // Decompresses a raw DEFLATE stream under the same limit
+        static bool raw(const uint8_t* _data, size_t _size, std::vector<uint8_t>& _out,
+                        size_t _maxOutput = DEFAULT_MAX_OUTPUT)
+        {
+            return Inflater(_data, _size, _out, _maxOutput)._inflate();
+        }
+
+    protected:
+        inline void _refill()
+        {
+            while (_count <= 56)
+            {
+                _bits |= static_cast<uint64_t>(_pos < _size ? _data[_pos] : 0) << _count;
+                _pos++;
+                _count += 8;
+            }
+        }
+        inline uint32_t _take(int _n)
+        {
+            if (_count < _n)
+            {
+                _refill();
+            }
+            auto _v = static_cast<uint32_t>(_bits & ((uint64_t(1) << _n) - 1));
+            _bits >>= _n;
+            _count -= _n;
+            return _v;
+        }
+        // Bytes past the end of input read as zero; this tells whether any were consumed
+        inline bool _overrun() const
+        {
+            return _pos - _count / 8 > _size;
+        }
+
+        inline int _decode(const HuffmanTable& _table)
+        {
+            if (_count < 16)
+            {
+                _refill();
+            }
+            auto _entry = _table.fast[_bits & ((1 << HuffmanTable::FAST_BITS) - 1)];
+            if (_entry)
+            {
+                _bits >>= _entry >> 9;
+                _count -= _entry >> 9;
+                return _entry & 0x1ff;
+            }
+            int _code = 0, _first = 0, _index = 0;
+            for (int _len = 1; _len < 16; _len++)
+            {
+                _code |= _take(1);
+                int _n = _table.counts[_len];
+                if (_code - _n < _first)
+                {
+                    return _table.symbols[_index + (_code - _first)];
+                }
+                _index += _n;
+                _first = (_first + _n) << 1;
+                _code <<= 1;
+            }
+            return -1;
+        }
+
+        bool _inflate()
+        {
+            static constexpr uint16_t _lengthBase[29]{ 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static constexpr uint8_t _lengthExtra[29]{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            static constexpr uint16_t _distBase[30]{ 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static constexpr uint8_t _distExtra[30]{ 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+            HuffmanTable _lit, _dist;
+            bool _final;
+            do
+            {
+                _final = _take(1);
+                uint32_t _type = _take(2);
+                if (_type == 0)
+                {
+                    _take(_count & 7);
+                    uint32_t _len = _take(16), _nlen = _take(16);
+                    if ((_len ^ 0xffff) != _nlen || _len > _limit - _out.size())
+                    {
+                        return false;
+                    }
+                    for (uint32_t _i = 0; _i < _len; _i++)
+                    {
+                        _out.push_back(static_cast<uint8_t>(_take(8)));
+                    }
+                }
+                else if (_type == 1 || _type == 2)
+                {
+                    if (!(_type == 1 ? _fixedTables(_lit, _dist) : _dynamicTables(_lit, _dist)))
+                    {
+                        return false;
+                    }
+                    for (;;)
+                    {
+                        int _symbol = _decode(_lit);
+                        if (_symbol < 256)
+                        {
+                            if (_symbol < 0 || _out.size() >= _limit)
+                            {
+                                return false;
+                            }
+                            _out.push_back(static_cast<uint8_t>(_symbol));
+                            continue;
+                        }
+                        if (_symbol == 256)
+                        {
+                            break;
+                        }
+                        _symbol -= 257;
+                        if (_symbol >= 29)
+                        {
+                            return false;
+                        }
+                        size_t _length = _lengthBase[_symbol] + _take(_lengthExtra[_symbol]);
+                        int _d = _decode(_dist);
+                        if (_d < 0 || _d >= 30)
+                        {
+                            return false;
+                        }
+                        size_t _distance = _distBase[_d] + _take(_distExtra[_d]);
+                        if (_distance > _out.size() || _length > _limit - _out.size())
+                        {
+                            return false;
+                        }
+                        size_t _from = _out.size() - _distance;
+                        for (size_t _i = 0; _i < _length; _i++)
+                        {
+                            _out.push_back(_out[_from + _i]);
+                        }
+                    }
+                }
+                else
+                {
+                    return false;
+                }
+                if (_overrun())
+                {
+                    return false;
+                }
+            } while (!_final);
+            return true;
+        }
+
+        bool _fixedTables(HuffmanTable& _lit, HuffmanTable& _dist)
+        {
+            uint8_t _lengths[288];
+            memset(_lengths, 8, 144);
+            memset(_lengths + 144, 9, 112);
+            memset(_lengths + 256, 7, 24);
+            memset(_lengths + 280, 8, 8);
+            _lit.build(_lengths, 288);
+            memset(_lengths, 5, 30);
+            _dist.build(_lengths, 30);
+            return true;
+        }
+        bool _dynamicTables(HuffmanTable& _lit, HuffmanTable& _dist)
+        {
+            static constexpr uint8_t _order[19]{ 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            int _nlit = _take(5) + 257, _ndist = _take(5) + 1, _ncode = _take(4) + 4;
+            uint8_t _lengths[288 + 32]{};
+            for (int _i = 0; _i < _ncode; _i++)
+            {
+                _lengths[_order[_i]] = static_cast<uint8_t>(_take(3));
+            }
+            HuffmanTable _codeTable;
+            if (_nlit > 286 || _ndist > 30 || !_codeTable.build(_lengths, 19))
+            {
+                return false;
+            }
+            memset(_lengths, 0, 19);
+            for (int _i = 0; _i < _nlit + _ndist;)
+            {
+                int _symbol = _decode(_codeTable);
+                if (_symbol < 0)
+                {
+                    return false;
+                }
+                if (_symbol < 16)
+                {
+                    _lengths[_i++] = static_cast<uint8_t>(_symbol);
+                    continue;
+                }
+                uint8_t _value = 0;
+                int _repeat;
+                if (_symbol == 16)
+                {
+                    if (_i == 0)
+                    {
+                        return false;
+                    }
+                    _value = _lengths[_i - 1];
+                    _repeat = 3 + _take(2);
+                }
+                else
+                {
+                    _repeat = _symbol == 17 ? 3 + _take(3) : 11 + _take(7);
+                }
+                if (_i + _repeat > _nlit + _ndist)
+                {
+                    return false;
+                }
+                while (_repeat--)
+                {
+                    _lengths[_i++] = _value;
+                }
+            }
+            return _lengths[256] && _lit.build(_lengths, _nlit) && _dist.build(_lengths + _nlit, _ndist);
+        }
+    };
+};
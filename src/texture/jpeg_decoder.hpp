@@ -0,0 +1,623 @@
+#pragma once
+#include "image_codec.hpp"
+#include <algorithm>
+
+namespace lightroom
+{
+    // Baseline JPEG decoder for greyscale, YCbCr and Adobe RGB files with any chroma subsampling.
+    // Entropy decoding is serial; dequantisation, IDCT, upsampling and colour conversion
+    // are spread over MCU rows.
+    class JpegDecoder
+    {
+    protected:
+        inline static constexpr uint8_t _zigzag[64]{
+            0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+            12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+            35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+            58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+        // Canonical Huffman code, most significant bit first, with a direct lookup for short codes
+        struct HuffmanTable
+        {
+            static constexpr int FAST_BITS = 9;
+
+            uint16_t fast[1 << FAST_BITS];  // symbol | length << 8, zero when the code is longer
+            int32_t maxCode[18];
+            int32_t offset[17];
+            uint8_t symbols[256];
+            bool defined = false;
+
+            bool build(const uint8_t* _counts, const uint8_t* _symbols, int _total)
+            {
+                memcpy(symbols, _symbols, _total);
+                memset(fast, 0, sizeof(fast));
+                int _code = 0, _k = 0;
+                for (int _len = 1; _len <= 16; _len++)
+                {
+                    offset[_len] = _k - _code;
+                    for (int _i = 0; _i < _counts[_len - 1]; _i++, _k++, _code++)
+                    {
+                        // an over-subscribed length has no code left for this symbol, and its
+                        // fast entries would land past the table
+                        if (_code >= (1 << _len))
+                        {
+                            return false;
+                        }
+                        if (_len <= FAST_BITS)
+                        {
+                            int _first = _code << (FAST_BITS - _len);
+                            for (int _j = 0; _j < (1 << (FAST_BITS - _len)); _j++)
+                            {
+                                fast[_first + _j] = static_cast<uint16_t>(symbols[_k] | (_len << 8));
+                            }
+                        }
+                    }
+                    maxCode[_len] = _counts[_len - 1] ? _code - 1 : -1;
+                    _code <<= 1;
+                }
+                maxCode[17] = INT32_MAX;
+                defined = true;
+                return true;
+            }
+        };
+
+        struct Component
+        {
+            int id;
+            int h, v;
+            int quant;
+            int dcTable, acTable;
+            int blocksX, blocksY;       // padded to whole MCUs
+            int dcPredictor;
+            std::vector<int16_t> coefficients;
+            std::vector<uint8_t> plane;
+        };
+
+        // Entropy-coded segment reader: undoes 0xFF00 stuffing and stops at the next marker
+        struct BitReader
+        {
+            const uint8_t* pos;
+            const uint8_t* end;
+            uint32_t bits = 0;
+            int count = 0;
+            bool marker = false;
+
+            inline void fill()
+            {
+                while (count <= 24)
+                {
+                    uint32_t _byte = 0;
+                    if (!marker && pos < end)
+                    {
+                        if (*pos != 0xff)
+                        {
+                            _byte = *pos++;
+                        }
+                        else if (pos + 1 < end && pos[1] == 0)
+                        {
+                            _byte = 0xff;
+                            pos += 2;
+                        }
+                        else
+                        {
+                            marker = true;
+                        }
+                    }
+                    bits |= _byte << (24 - count);
+                    count += 8;
+                }
+            }
+            inline uint32_t take(int _n)
+            {
+                if (!_n)
+                {
+                    return 0;
+                }
+                if (count < _n)
+                {
+                    fill();
+                }
+                uint32_t _v = bits >> (32 - _n);
+                bits <<= _n;
+                count -= _n;
+                return _v;
+            }
+            // JPEG's signed magnitude coding of an _n bit value
+            inline int extend(int _n)
+            {
+                int _v = static_cast<int>(take(_n));
+                return _n && _v < (1 << (_n - 1)) ? _v - (1 << _n) + 1 : _v;
+            }
+            inline int decode(const HuffmanTable& _table)
+            {
+                if (count < 16)
+                {
+                    fill();
+                }
+                auto _entry = _table.fast[bits >> (32 - HuffmanTable::FAST_BITS)];
+                if (_entry)
+                {
+                    bits <<= _entry >> 8;
+                    count -= _entry >> 8;
+                    return _entry & 0xff;
+                }
+                int _len = HuffmanTable::FAST_BITS + 1;
+                while (static_cast<int32_t>(bits >> (32 - _len)) > _table.maxCode[_len])
+                {
+                    _len++;
+                }
+                if (_len > 16)
+                {
+                    return -1;
+                }
+                int _code = static_cast<int>(bits >> (32 - _len));
+                bits <<= _len;
+                count -= _len;
+                return _table.symbols[(_table.offset[_len] + _code) & 0xff];
+            }
+        };
+
+        uint16_t _quant[4][64]{};
+        HuffmanTable _dc[4], _ac[4];
+        std::vector<Component> _components;
+        int _width = 0, _height = 0;
+        int _hMax = 1, _vMax = 1;
+        int _mcusX = 0, _mcusY = 0;
+        int _restartInterval = 0;
+        int _adobeTransform = -1;
+
+    public:
+        inline static bool matches(const uint8_t* _data, size_t _size)
+        {
+            return _size >= 3 && _data[0] == 0xff && _data[1] == 0xd8 && _data[2] == 0xff;
+        }
+
+        // Walks the marker segments up to the frame header without decoding anything
+        static bool probe(const uint8_t* _data, size_t _size, int& _width, int& _height)
+        {
+            if (!matches(_data, _size))
+            {
+                return false;
+            }
+            for (size_t _pos = 2; _pos + 9 <= _size && _data[_pos] == 0xff;)
+            {
+                uint8_t _marker = _data[_pos + 1];
+                if (_marker == 0xff)
+                {
+                    _pos++;
+                    continue;
+                }
+                if (_marker >= 0xc0 && _marker <= 0xcf && _marker != 0xc4 && _marker != 0xc8 && _marker != 0xcc)
+                {
+                    _width = _be16(_data + _pos + 7);
+                    _height = _be16(_data + _pos + 5);
+                    return _width > 0 && _height > 0;
+                }
+                _pos += 2 + static_cast<size_t>(_be16(_data + _pos + 2));
+            }
+            return false;
+        }
+
+        // Returns nullptr for malformed, progressive, arithmetic-coded or CMYK files
+        static std::unique_ptr<TexelImage> decode(const uint8_t* _data, size_t _size, const ParallelFor& _parallelFor = nullptr)
+        {
+            return JpegDecoder()._decode(_data, _size, _parallelFor);
+        }
+
+    protected:
+        inline static int _be16(const uint8_t* _p)
+        {
+            return (_p[0] << 8) | _p[1];
+        }
+
+        std::unique_ptr<TexelImage> _decode(const uint8_t* _data, size_t _size, const ParallelFor& _parallelFor)
+        {
+            if (!matches(_data, _size))
+            {
+                return nullptr;
+            }
+            const uint8_t* _end = _data + _size;
+            const uint8_t* _p = _data + 2;
+            bool _frame = false, _scanned = false;
+            while (_p + 4 <= _end)
+            {
+                if (*_p != 0xff)
+                {
+                    return nullptr;
+                }
+                uint8_t _marker = _p[1];
+                if (_marker == 0xff)
+                {
+                    _p++;
+                    continue;
+                }
+                if (_marker == 0xd9)
+                {
+                    break;
+                }
+                int _length = _be16(_p + 2);
+                const uint8_t* _segment = _p + 4;
+                if (_length < 2 || _segment + _length - 2 > _end)
+                {
+                    return nullptr;
+                }
+                _p = _segment + _length - 2;
+
+                switch (_marker)
+                {
+                case 0xc0:
+                case 0xc1:
+                    if (_frame || !_readFrame(_segment, _length - 2))
+                    {
+                        return nullptr;
+                    }
+                    _frame = true;
+                    break;
+                case 0xc4:
+                    if (!_readHuffman(_segment, _length - 2))
+                    {
+                        return nullptr;
+                    }
+                    break;
+                case 0xdb:
+                    if (!_readQuantization(_segment, _length - 2))
+                    {
+                        return nullptr;
+                    }
+                    break;
+                case 0xdd:
+                    if (_length < 4)
+                    {
+                        return nullptr;
+                    }
+                    _restartInterval = _be16(_segment);
+                    break;
+                case 0xda:
+                    if (!_frame || !(_p = _readScan(_segment, _length - 2, _end)))
+                    {
+                        return nullptr;
+                    }
+                    _scanned = true;
+                    break;
+                case 0xee:
+                    if (_length >= 14 && !memcmp(_segment, "Adobe", 5))
+                    {
+                        _adobeTransform = _segment[11];
+                    }
+                    break;
+                default:
+                    // other SOFn are progressive, lossless or arithmetic coded
+                    if (_marker >= 0xc2 && _marker <= 0xcf)
+                    {
+                        return nullptr;
+                    }
+                    break;
+                }
+            }
+            if (!_scanned)
+            {
+                return nullptr;
+            }
+
+            auto _image = std::make_unique<TexelImage>(_width, _height);
+            runParallel(_parallelFor, static_cast<size_t>(_mcusY),
+                        [&](size_t _row)
+                        {
+                            for (auto& _c : _components)
+                            {
+                                _reconstruct(_c, static_cast<int>(_row));
+                            }
+                            _colorConvert(*_image, static_cast<int>(_row));
+                        });
+            return _image;
+        }
+
+        bool _readFrame(const uint8_t* _s, int _length)
+        {
+            if (_length < 6 || _s[0] != 8)
+            {
+                return false;
+            }
+            _height = _be16(_s + 1);
+            _width = _be16(_s + 3);
+            int _count = _s[5];
+            if (!_width || !_height || (_count != 1 && _count != 3) || _length < 6 + 3 * _count)
+            {
+                return false;
+            }
+            for (int _i = 0; _i < _count; _i++)
+            {
+                const uint8_t* _c = _s + 6 + 3 * _i;
+                Component _component{ _c[0], _c[1] >> 4, _c[1] & 15, _c[2] & 3 };
+                if (_component.h < 1 || _component.h > 4 || _component.v < 1 || _component.v > 4)
+                {
+                    return false;
+                }
+                _hMax = (std::max)(_hMax, _component.h);
+                _vMax = (std::max)(_vMax, _component.v);
+                _components.push_back(std::move(_component));
+            }
+            _mcusX = (_width + 8 * _hMax - 1) / (8 * _hMax);
+            _mcusY = (_height + 8 * _vMax - 1) / (8 * _vMax);
+            for (auto& _c : _components)
+            {
+                _c.blocksX = _mcusX * _c.h;
+                _c.blocksY = _mcusY * _c.v;
+                _c.coefficients.assign(static_cast<size_t>(_c.blocksX) * _c.blocksY * 64, 0);
+                _c.plane.resize(static_cast<size_t>(_c.blocksX) * _c.blocksY * 64);
+            }
+            return true;
+        }
+
+        bool _readHuffman(const uint8_t* _s, int _length)
+        {
+            while (_length >= 17)
+            {
+                int _class = _s[0] >> 4, _index = _s[0] & 15;
+                int _total = 0;
+                for (int _i = 0; _i < 16; _i++)
+                {
+                    _total += _s[1 + _i];
+                }
+                if (_class > 1 || _index > 3 || _total > 256 || _length < 17 + _total ||
+                    !(_class ? _ac : _dc)[_index].build(_s + 1, _s + 17, _total))
+                {
+                    return false;
+                }
+                _s += 17 + _total;
+                _length -= 17 + _total;
+            }
+            return true;
+        }
+
+        bool _readQuantization(const uint8_t* _s, int _length)
+        {
+            while (_length >= 65)
+            {
+                int _precision = _s[0] >> 4, _index = _s[0] & 15;
+                int _bytes = _precision ? 129 : 65;
+                if (_index > 3 || _length < _bytes)
+                {
+                    return false;
+                }
+                for (int _k = 0; _k < 64; _k++)
+                {
+                    _quant[_index][_zigzag[_k]] = static_cast<uint16_t>(_precision ? _be16(_s + 1 + 2 * _k) : _s[1 + _k]);
+                }
+                _s += _bytes;
+                _length -= _bytes;
+            }
+            return true;
+        }
+
+        // Decodes one scan into the coefficient buffers; returns the position of the next marker
+        const uint8_t* _readScan(const uint8_t* _s, int _length, const uint8_t* _end)
+        {
+            int _count = _length > 0 ? _s[0] : 0;
+            if (_count < 1 || _count > 4 || _length < 4 + 2 * _count || _s[1 + 2 * _count] != 0 || _s[2 + 2 * _count] != 63)
+            {
+                return nullptr;
+            }
+            std::vector<Component*> _scan;
+            for (int _i = 0; _i < _count; _i++)
+            {
+                auto _c = std::find_if(_components.begin(), _components.end(),
+                                       [&](const Component& _c) { return _c.id == _s[1 + 2 * _i]; });
+                if (_c == _components.end())
+                {
+                    return nullptr;
+                }
+                _c->dcTable = _s[2 + 2 * _i] >> 4;
+                _c->acTable = _s[2 + 2 * _i] & 3;
+                if (_c->dcTable > 3 || !_dc[_c->dcTable].defined || !_ac[_c->acTable].defined)
+                {
+                    return nullptr;
+                }
+                _c->dcPredictor = 0;
+                _scan.push_back(&*_c);
+            }
+
+            BitReader _reader{ _s + _length, _end };
+            // a single-component scan walks that component's own blocks, not whole MCUs
+            int _unitsX = _count == 1 ? ((_width * _scan[0]->h + _hMax - 1) / _hMax + 7) / 8 : _mcusX;
+            int _unitsY = _count == 1 ? ((_height * _scan[0]->v + _vMax - 1) / _vMax + 7) / 8 : _mcusY;
+            size_t _units = static_cast<size_t>(_unitsX) * _unitsY;
+            for (size_t _unit = 0; _unit < _units; _unit++)
+            {
+                if (_restartInterval && _unit && _unit % _restartInterval == 0)
+                {
+                    if (!_restart(_reader))
+                    {
+                        return nullptr;
+                    }
+                    for (auto _c : _scan)
+                    {
+                        _c->dcPredictor = 0;
+                    }
+                }
+                int _ux = static_cast<int>(_unit % _unitsX), _uy = static_cast<int>(_unit / _unitsX);
+                for (auto _c : _scan)
+                {
+                    int _h = _count == 1 ? 1 : _c->h, _v = _count == 1 ? 1 : _c->v;
+                    for (int _by = 0; _by < _v; _by++)
+                    {
+                        for (int _bx = 0; _bx < _h; _bx++)
+                        {
+                            size_t _block = static_cast<size_t>(_uy * _v + _by) * _c->blocksX + _ux * _h + _bx;
+                            if (!_decodeBlock(_reader, *_c, _c->coefficients.data() + _block * 64))
+                            {
+                                return nullptr;
+                            }
+                        }
+                    }
+                }
+            }
+
+            // skip padding up to the next marker that is not a restart
+            const uint8_t* _p = _reader.pos;
+            while (_p + 1 < _end && !(_p[0] == 0xff && _p[1] && (_p[1] < 0xd0 || _p[1] > 0xd7)))
+            {
+                _p++;
+            }
+            return _p;
+        }
+
+        bool _restart(BitReader& _reader)
+        {
+            _reader.bits = 0;
+            _reader.count = 0;
+            _reader.marker = false;
+            while (_reader.pos + 1 < _reader.end && !(_reader.pos[0] == 0xff && _reader.pos[1] >= 0xd0 && _reader.pos[1] <= 0xd7))
+            {
+                _reader.pos++;
+            }
+            if (_reader.pos + 1 >= _reader.end)
+            {
+                return false;
+            }
+            _reader.pos += 2;
+            return true;
+        }
+
+        inline bool _decodeBlock(BitReader& _reader, Component& _c, int16_t* _block)
+        {
+            int _t = _reader.decode(_dc[_c.dcTable]);
+            if (_t < 0 || _t > 11)
+            {
+                return false;
+            }
+            _c.dcPredictor += _reader.extend(_t);
+            _block[0] = static_cast<int16_t>(_c.dcPredictor);
+            for (int _k = 1; _k < 64;)
+            {
+                int _rs = _reader.decode(_ac[_c.acTable]);
+                if (_rs < 0)
+                {
+                    return false;
+                }
+                int _run = _rs >> 4, _bits = _rs & 15;
+                if (!_bits)
+                {
+                    if (_run != 15)
+                    {
+                        break;
+                    }
+                    _k += 16;
+                    continue;
+                }
+                _k += _run;
+                if (_k > 63)
+                {
+                    return false;
+                }
+                _block[_zigzag[_k++]] = static_cast<int16_t>(_reader.extend(_bits));
+            }
+            return true;
+        }
+
+        // Dequantises and inverse transforms one MCU row of a component into its sample plane
+        void _reconstruct(Component& _c, int _row) const
+        {
+            static const auto _basis = []()
+            {
+                std::array<float, 64> _b{};
+                for (int _x = 0; _x < 8; _x++)
+                {
+                    for (int _u = 0; _u < 8; _u++)
+                    {
+                        _b[_x * 8 + _u] = static_cast<float>((_u ? 0.5 : 0.5 / std::sqrt(2.0)) *
+                                                             std::cos((2 * _x + 1) * _u * 3.14159265358979323846 / 16));
+                    }
+                }
+                return _b;
+            }();
+
+            const uint16_t* _q = _quant[_c.quant];
+            size_t _stride = static_cast<size_t>(_c.blocksX) * 8;
+            for (int _by = _row * _c.v; _by < (_row + 1) * _c.v; _by++)
+            {
+                for (int _bx = 0; _bx < _c.blocksX; _bx++)
+                {
+                    const int16_t* _in = _c.coefficients.data() + (static_cast<size_t>(_by) * _c.blocksX + _bx) * 64;
+                    float _tmp[64];
+                    // columns, then rows
+                    for (int _u = 0; _u < 8; _u++)
+                    {
+                        float _col[8];
+                        for (int _v = 0; _v < 8; _v++)
+                        {
+                            _col[_v] = static_cast<float>(_in[_v * 8 + _u] * _q[_v * 8 + _u]);
+                        }
+                        for (int _y = 0; _y < 8; _y++)
+                        {
+                            float _sum = 0;
+                            for (int _v = 0; _v < 8; _v++)
+                            {
+                                _sum += _basis[_y * 8 + _v] * _col[_v];
+                            }
+                            _tmp[_y * 8 + _u] = _sum;
+                        }
+                    }
+                    uint8_t* _out = _c.plane.data() + static_cast<size_t>(_by) * 8 * _stride + _bx * 8;
+                    for (int _y = 0; _y < 8; _y++, _out += _stride)
+                    {
+                        for (int _x = 0; _x < 8; _x++)
+                        {
+                            float _sum = 128.5f;
+                            for (int _u = 0; _u < 8; _u++)
+                            {
+                                _sum += _basis[_x * 8 + _u] * _tmp[_y * 8 + _u];
+                            }
+                            _out[_x] = static_cast<uint8_t>(_sum <= 0 ? 0 : (_sum >= 255 ? 255 : _sum));
+                        }
+                    }
+                }
+            }
+        }
+
+        // Upsamples (nearest sample) and converts the pixel rows covered by one MCU row
+        void _colorConvert(TexelImage& _image, int _row) const
+        {
+            bool _ycc = _components.size() == 3 && _adobeTransform != 0 &&
+                !(_components[0].id == 'R' && _components[1].id == 'G' && _components[2].id == 'B');
+            int _y0 = _row * 8 * _vMax, _y1 = (std::min)(_height, _y0 + 8 * _vMax);
+            for (int _y = _y0; _y < _y1; _y++)
+            {
+                const uint8_t* _rows[3];
+                int _shift[3];
+                for (size_t _i = 0; _i < _components.size(); _i++)
+                {
+                    auto& _c = _components[_i];
+                    _rows[_i] = _c.plane.data() + static_cast<size_t>(_y * _c.v / _vMax) * _c.blocksX * 8;
+                    _shift[_i] = _c.h;
+                }
+                Texel* _out = _image.getRow(_y);
+                if (_components.size() == 1)
+                {
+                    for (int _x = 0; _x < _width; _x++)
+                    {
+                        uint32_t _g = _rows[0][_x];
+                        _out[_x] = 0xff000000 | (_g << 16) | (_g << 8) | _g;
+                    }
+                    continue;
+                }
+                for (int _x = 0; _x < _width; _x++)
+                {
+                    int _a = _rows[0][_x * _shift[0] / _hMax];
+                    int _b = _rows[1][_x * _shift[1] / _hMax];
+                    int _c = _rows[2][_x * _shift[2] / _hMax];
+                    int _r = _a, _g = _b, _bl = _c;
+                    if (_ycc)
+                    {
+                        float _cb = static_cast<float>(_b - 128), _cr = static_cast<float>(_c - 128);
+                        _r = static_cast<int>(_a + 1.402f * _cr + 0.5f);
+                        _g = static_cast<int>(_a - 0.344136f * _cb - 0.714136f * _cr + 0.5f);
+                        _bl = static_cast<int>(_a + 1.772f * _cb + 0.5f);
+                    }
+                    auto _clamp = [](int _v) { return static_cast<uint32_t>(_v < 0 ? 0 : (_v > 255 ? 255 : _v)); };
+                    _out[_x] = 0xff000000 | (_clamp(_r) << 16) | (_clamp(_g) << 8) | _clamp(_bl);
+                }
+            }
+        }
+    };
+};
@@ -0,0 +1,112 @@
+#pragma once
+#include "sampler.hpp"
+
+namespace lightroom
+{
+    // Texture with a full mip chain built once at load time
+    class MipmapMap : public TextureMapBase<MipmapMap>
+    {
+    protected:
+        std::vector<MipLevel> _levels;
+
+    public:
+        MipmapMap(const ColorMap& _source) : TextureMapBase({ _source.getWidth(), _source.getHeight() })
+        {
+            MipLevel _base(_size);
+            for (int _y = 0; _y < _size[1]; _y++)
+            {
+                for (int _x = 0; _x < _size[0]; _x++)
+                {
+                    _base.store(_x, _y, packTexel(_source.get(static_cast<size_t>(_y) * _size[0] + _x)));
+                }
+            }
+            _levels = buildChain(std::move(_base));
+        }
+        MipmapMap(const DecodedImage& _source) : TextureMapBase({ _source.getWidth(), _source.getHeight() }),
+            _levels(buildChain(tileImage(_source))) {}
+        // Keeps at most _maxLevels levels, for sources whose coarse levels would be meaningless
+        MipmapMap(MipLevel&& _base, size_t _maxLevels) : TextureMapBase(_base.size),
+            _levels(buildChain(std::move(_base), _maxLevels)) {}
+        virtual ~MipmapMap() {}
+
+        virtual Color get(size_t _index) const override
+        {
+            return unpackTexel(_levels[0].fetch(static_cast<int>(_index % _size[0]),
+                                                static_cast<int>(_index / _size[0])));
+        }
+
+        inline size_t getLevelCount() const
+        {
+            return _levels.size();
+        }
+        inline const MipLevel& getLevel(size_t _level) const
+        {
+            return _levels[_level];
+        }
+
+        // Decoded texels are already packed, so they are only retiled
+        static MipLevel tileImage(const DecodedImage& _source)
+        {
+            MipLevel _base(PxCoordinate{ _source.getWidth(), _source.getHeight() });
+            for (int _y = 0; _y < _base.size[1]; _y++)
+            {
+                auto _row = _source.getRow(_y);
+                for (int _x = 0; _x < _base.size[0]; _x++)
+                {
+                    _base.store(_x, _y, _row[_x]);
+                }
+            }
+            return _base;
+        }
+        // 2x2 box filter down to 1x1 (or _maxLevels); odd edges reuse their last row/column
+        static std::vector<MipLevel> buildChain(MipLevel&& _base, size_t _maxLevels = SIZE_MAX)
+        {
+            std::vector<MipLevel> _levels;
+            _levels.push_back(std::move(_base));
+            while ((_levels.back().size[0] > 1 || _levels.back().size[1] > 1) && _levels.size() < _maxLevels)
+            {
+                const MipLevel& _src = _levels.back();
+                MipLevel _dst(nextLevelSize(_src.size));
+                int _w = _dst.size[0], _h = _dst.size[1];
+
+                for (int _y = 0; _y < _h; _y++)
+                {
+                    int _y0 = min(2 * _y, _src.size[1] - 1), _y1 = min(2 * _y + 1, _src.size[1] - 1);
+                    for (int _x = 0; _x < _w; _x++)
+                    {
+                        int _x0 = min(2 * _x, _src.size[0] - 1), _x1 = min(2 * _x + 1, _src.size[0] - 1);
+                        Texel _quad[4]{ _src.fetch(_x0, _y0), _src.fetch(_x1, _y0),
+                            _src.fetch(_x0, _y1), _src.fetch(_x1, _y1) };
+                        Texel _out = 0;
+                        for (int _shift = 0; _shift < 32; _shift += 8)
+                        {
+                            uint32_t _sum = 2;
+                            for (auto _t : _quad)
+                            {
+                                _sum += (_t >> _shift) & 0xff;
+                            }
+                            _out |= (_sum / 4) << _shift;
+                        }
+                        _dst.store(_x, _y, _out);
+                    }
+                }
+                _levels.push_back(std::move(_dst));
+            }
+            return _levels;
+        }
+        inline static PxCoordinate nextLevelSize(const PxCoordinate& _size)
+        {
+            return { max(1, _size[0] / 2), max(1, _size[1] / 2) };
+        }
+        // Number of levels buildChain produces for a base of _size
+        inline static size_t chainLength(PxCoordinate _size)
+        {
+            size_t _count = 1;
+            for (; _size[0] > 1 || _size[1] > 1; _count++)
+            {
+                _size = nextLevelSize(_size);
+            }
+            return _count;
+        }
+    };
+};
@@ -0,0 +1,319 @@
+#pragma once
+#include "inflate.hpp"
+#include <algorithm>
+
+namespace lightroom
+{
+    // PNG decoder: every colour type and bit depth, Adam7 interlacing and tRNS transparency.
+    // Decompression and unfiltering are serial; texel conversion is spread over rows.
+    class PngDecoder
+    {
+    protected:
+        enum ColorType : uint8_t
+        {
+            GRAY = 0,
+            RGB = 2,
+            PALETTE = 3,
+            GRAY_ALPHA = 4,
+            RGBA = 6
+        };
+
+        // Adam7 passes: x and y origin, x and y step
+        inline static constexpr int _adam7[7][4]{
+            { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 },
+            { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+
+        int _width = 0, _height = 0;
+        int _depth = 0;
+        ColorType _colorType = GRAY;
+        int _channels = 1;
+        bool _interlaced = false;
+        Texel _palette[256]{};
+        bool _hasKey = false;
+        uint16_t _key[3]{};
+
+    public:
+        inline static bool matches(const uint8_t* _data, size_t _size)
+        {
+            static constexpr uint8_t _signature[8]{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+            return _size >= 8 && !memcmp(_data, _signature, 8);
+        }
+
+        // Reads the dimensions from IHDR without decoding anything
+        static bool probe(const uint8_t* _data, size_t _size, int& _width, int& _height)
+        {
+            if (!matches(_data, _size) || _size < 24 || memcmp(_data + 12, "IHDR", 4))
+            {
+                return false;
+            }
+            _width = static_cast<int>(_be32(_data + 16));
+            _height = static_cast<int>(_be32(_data + 20));
+            return _width > 0 && _height > 0;
+        }
+
+        // Returns nullptr for malformed or truncated files
+        static std::unique_ptr<TexelImage> decode(const uint8_t* _data, size_t _size, const ParallelFor& _parallelFor = nullptr)
+        {
+            return PngDecoder()._decode(_data, _size, _parallelFor);
+        }
+
+    protected:
+        inline static uint32_t _be32(const uint8_t* _p)
+        {
+            return (static_cast<uint32_t>(_p[0]) << 24) | (_p[1] << 16) | (_p[2] << 8) | _p[3];
+        }
+
+        std::unique_ptr<TexelImage> _decode(const uint8_t* _data, size_t _size, const ParallelFor& _parallelFor)
+        {
+            if (!matches(_data, _size))
+            {
+                return nullptr;
+            }
+            std::vector<uint8_t> _compressed;
+            bool _header = false;
+            for (size_t _pos = 8; _pos + 12 <= _size;)
+            {
+                uint32_t _length = _be32(_data + _pos);
+                const uint8_t* _type = _data + _pos + 4;
+                const uint8_t* _chunk = _data + _pos + 8;
+                if (_length > _size - _pos - 12)
+                {
+                    return nullptr;
+                }
+                _pos += 12 + static_cast<size_t>(_length);
+
+                if (!memcmp(_type, "IHDR", 4))
+                {
+                    if (_length < 13 || !_readHeader(_chunk))
+                    {
+                        return nullptr;
+                    }
+                    _header = true;
+                }
+                else if (!memcmp(_type, "PLTE", 4))
+                {
+                    for (uint32_t _i = 0; _i < _length / 3 && _i < 256; _i++)
+                    {
+                        _palette[_i] = 0xff000000 | (_chunk[3 * _i] << 16) | (_chunk[3 * _i + 1] << 8) | _chunk[3 * _i + 2];
+                    }
+                }
+                else if (!memcmp(_type, "tRNS", 4))
+                {
+                    _readTransparency(_chunk, _length);
+                }
+                else if (!memcmp(_type, "IDAT", 4))
+                {
+                    _compressed.insert(_compressed.end(), _chunk, _chunk + _length);
+                }
+                else if (!memcmp(_type, "IEND", 4))
+                {
+                    break;
+                }
+            }
+            if (!_header || _compressed.empty())
+            {
+                return nullptr;
+            }
+
+            std::vector<uint8_t> _filtered;
+            _filtered.reserve(_imageBytes());
+            // trailing bytes past the image are tolerated but bounded, so a small stream cannot expand unchecked
+            if (!Inflater::zlib(_compressed.data(), _compressed.size(), _filtered, _imageBytes() + 1024) ||
+                _filtered.size() < _imageBytes())
+            {
+                return nullptr;
+            }
+
+            auto _image = std::make_unique<TexelImage>(_width, _height);
+            if (!_interlaced)
+            {
+                _unfilter(_filtered.data(), _width, _height);
+                size_t _stride = _rowBytes(_width);
+                runParallel(_parallelFor, static_cast<size_t>(_height),
+                            [&](size_t _y)
+                            {
+                                _convert(_filtered.data() + _y * (_stride + 1) + 1, _width, _image->getRow(static_cast<int>(_y)), 1);
+                            });
+                return _image;
+            }
+
+            // Adam7: each pass is a small image of its own, scattered into the full one
+            uint8_t* _pass = _filtered.data();
+            for (auto& _p : _adam7)
+            {
+                int _w = (_width - _p[0] + _p[2] - 1) / _p[2];
+                int _h = (_height - _p[1] + _p[3] - 1) / _p[3];
+                if (_w <= 0 || _h <= 0)
+                {
+                    continue;
+                }
+                _unfilter(_pass, _w, _h);
+                size_t _stride = _rowBytes(_w);
+                runParallel(_parallelFor, static_cast<size_t>(_h),
+                            [&](size_t _y)
+                            {
+                                _convert(_pass + _y * (_stride + 1) + 1, _w,
+                                         _image->getRow(_p[1] + static_cast<int>(_y) * _p[3]) + _p[0], _p[2]);
+                            });
+                _pass += (_stride + 1) * _h;
+            }
+            return _image;
+        }
+
+        bool _readHeader(const uint8_t* _chunk)
+        {
+            uint32_t _w = _be32(_chunk), _h = _be32(_chunk + 4);
+            _depth = _chunk[8];
+            _colorType = static_cast<ColorType>(_chunk[9]);
+            _interlaced = _chunk[12] == 1;
+            switch (_colorType)
+            {
+            case GRAY: _channels = 1; break;
+            case RGB: _channels = 3; break;
+            case PALETTE: _channels = 1; break;
+            case GRAY_ALPHA: _channels = 2; break;
+            case RGBA: _channels = 4; break;
+            default: return false;
+            }
+            bool _validDepth = _colorType == GRAY ? (_depth == 1 || _depth == 2 || _depth == 4 || _depth == 8 || _depth == 16) :
+                _colorType == PALETTE ? (_depth == 1 || _depth == 2 || _depth == 4 || _depth == 8) :
+                (_depth == 8 || _depth == 16);
+            if (!_validDepth || _w == 0 || _h == 0 || _w > (1u << 24) || _h > (1u << 24) ||
+                static_cast<uint64_t>(_w) * _h > (1ull << 30) || _chunk[10] || _chunk[11] || _chunk[12] > 1)
+            {
+                return false;
+            }
+            _width = static_cast<int>(_w);
+            _height = static_cast<int>(_h);
+            return true;
+        }
+
+        void _readTransparency(const uint8_t* _chunk, uint32_t _length)
+        {
+            if (_colorType == PALETTE)
+            {
+                for (uint32_t _i = 0; _i < _length && _i < 256; _i++)
+                {
+                    _palette[_i] = (_palette[_i] & 0x00ffffff) | (static_cast<uint32_t>(_chunk[_i]) << 24);
+                }
+            }
+            else if ((_colorType == GRAY && _length >= 2) || (_colorType == RGB && _length >= 6))
+            {
+                _hasKey = true;
+                for (int _c = 0; _c < _channels; _c++)
+                {
+                    _key[_c] = static_cast<uint16_t>((_chunk[2 * _c] << 8) | _chunk[2 * _c + 1]);
+                }
+            }
+        }
+
+        inline size_t _rowBytes(int _w) const
+        {
+            return (static_cast<size_t>(_w) * _channels * _depth + 7) / 8;
+        }
+        size_t _imageBytes() const
+        {
+            if (!_interlaced)
+            {
+                return (_rowBytes(_width) + 1) * _height;
+            }
+            size_t _bytes = 0;
+            for (auto& _p : _adam7)
+            {
+                int _w = (_width - _p[0] + _p[2] - 1) / _p[2];
+                int _h = (_height - _p[1] + _p[3] - 1) / _p[3];
+                if (_w > 0 && _h > 0)
+                {
+                    _bytes += (_rowBytes(_w) + 1) * _h;
+                }
+            }
+            return _bytes;
+        }
+
+        // Undoes the per-row filters in place; each row depends on the one above
+        void _unfilter(uint8_t* _rows, int _w, int _h) const
+        {
+            size_t _stride = _rowBytes(_w);
+            size_t _bpp = (std::max)(1, _channels * _depth / 8);
+            const uint8_t* _prior = nullptr;
+            for (int _y = 0; _y < _h; _y++)
+            {
+                uint8_t _filter = _rows[0];
+                uint8_t* _row = _rows + 1;
+                for (size_t _i = 0; _i < _stride; _i++)
+                {
+                    int _a = _i >= _bpp ? _row[_i - _bpp] : 0;
+                    int _b = _prior ? _prior[_i] : 0;
+                    int _c = _prior && _i >= _bpp ? _prior[_i - _bpp] : 0;
+                    switch (_filter)
+                    {
+                    case 1: _row[_i] += static_cast<uint8_t>(_a); break;
+                    case 2: _row[_i] += static_cast<uint8_t>(_b); break;
+                    case 3: _row[_i] += static_cast<uint8_t>((_a + _b) >> 1); break;
+                    case 4:
+                    {
+                        int _p = _a + _b - _c;
+                        int _pa = abs(_p - _a), _pb = abs(_p - _b), _pc = abs(_p - _c);
+                        _row[_i] += static_cast<uint8_t>(_pa <= _pb && _pa <= _pc ? _a : (_pb <= _pc ? _b : _c));
+                        break;
+                    }
+                    default: break;
+                    }
+                }
+                _prior = _row;
+                _rows += _stride + 1;
+            }
+        }
+
+        inline uint16_t _sample(const uint8_t* _row, size_t _index) const
+        {
+            switch (_depth)
+            {
+            case 16: return static_cast<uint16_t>((_row[2 * _index] << 8) | _row[2 * _index + 1]);
+            case 8: return _row[_index];
+            default:
+            {
+                size_t _bit = _index * _depth;
+                return (_row[_bit >> 3] >> (8 - _depth - (_bit & 7))) & ((1 << _depth) - 1);
+            }
+            }
+        }
+        inline uint32_t _to8(uint16_t _value) const
+        {
+            return _depth == 16 ? _value >> 8 : (_depth == 8 ? _value : _value * 255 / ((1 << _depth) - 1));
+        }
+
+        // Converts one unfiltered row of _w pixels into texels _step apart
+        void _convert(const uint8_t* _row, int _w, Texel* _out, int _step) const
+        {
+            for (int _x = 0; _x < _w; _x++, _out += _step)
+            {
+                size_t _s = static_cast<size_t>(_x) * _channels;
+                switch (_colorType)
+                {
+                case PALETTE:
+                    *_out = _palette[_sample(_row, _s)];
+                    break;
+                case GRAY:
+                case GRAY_ALPHA:
+                {
+                    uint16_t _raw = _sample(_row, _s);
+                    uint32_t _g = _to8(_raw);
+                    uint32_t _a = _colorType == GRAY_ALPHA ? _to8(_sample(_row, _s + 1)) :
+                        (_hasKey && _raw == _key[0] ? 0 : 255);
+                    *_out = (_a << 24) | (_g << 16) | (_g << 8) | _g;
+                    break;
+                }
+                default:
+                {
+                    uint16_t _r = _sample(_row, _s), _g = _sample(_row, _s + 1), _b = _sample(_row, _s + 2);
+                    uint32_t _a = _colorType == RGBA ? _to8(_sample(_row, _s + 3)) :
+                        (_hasKey && _r == _key[0] && _g == _key[1] && _b == _key[2] ? 0 : 255);
+                    *_out = (_a << 24) | (_to8(_r) << 16) | (_to8(_g) << 8) | _to8(_b);
+                    break;
+                }
+                }
+            }
+        }
+    };
+};
@@ -0,0 +1,249 @@
+#pragma once
+#include "mipmap.hpp"
+
+namespace lightroom
+{
+    class ProceduralMap;
+
+    // One mip level of a ProceduralMap; fetches go through the map's tile cache
+    struct ProceduralLevel
+    {
+        PxCoordinate size;
+        size_t level;
+        const ProceduralMap* map;
+
+        inline Texel fetch(int _x, int _y) const;
+    };
+
+    // Texture computed by a generator instead of stored. The generator runs once per 32x32 tile
+    // and mip level, on first access; tiles live in a bounded LRU cache shared by every thread,
+    // with a few recently used tiles also held per thread so most fetches take no lock.
+    // Call invalidate() between frames when the generator's output changes, e.g. for animation.
+    class ProceduralMap : public TextureMapBase<ProceduralMap>
+    {
+    public:
+        // Colour at _uv for a texel covering _footprint in uv; generators may band-limit with it
+        using Generator = std::function<Color(const UVCoordinate& _uv, const UVCoordinate& _footprint)>;
+
+        static constexpr int TILE_SHIFT = 5;
+        static constexpr int TILE_SIZE = 1 << TILE_SHIFT;
+
+    protected:
+        struct Tile
+        {
+            Texel texels[TILE_SIZE * TILE_SIZE];
+        };
+        struct CachedTile
+        {
+            std::shared_ptr<const Tile> tile;
+            std::list<uint64_t>::iterator lru;
+        };
+        // Direct-mapped, private to the calling thread
+        struct LocalCache
+        {
+            static constexpr size_t ENTRIES = 8;
+            struct Entry
+            {
+                uint32_t id = UINT32_MAX;
+                uint64_t key = 0;
+                std::shared_ptr<const Tile> tile;
+            } entries[ENTRIES];
+        };
+
+        Generator _generator;
+        std::vector<ProceduralLevel> _levels;
+        size_t _maxTiles;
+        std::atomic<uint32_t> _id;
+
+        mutable std::mutex _mutex;
+        mutable std::unordered_map<uint64_t, CachedTile> _tiles;
+        mutable std::list<uint64_t> _lru;     // most recently used first
+        mutable std::atomic<size_t> _generated = 0;
+
+    public:
+        // _size is the resolution of level 0; _maxTiles bounds the shared cache at 4 KiB per tile,
+        // and the default holds a whole 1080p level 0
+        ProceduralMap(const PxCoordinate& _size, Generator _generator, size_t _maxTiles = 2048) :
+            TextureMapBase(_size), _generator(std::move(_generator)), _maxTiles(max(size_t(1), _maxTiles)),
+            _id(_nextId())
+        {
+            PxCoordinate _levelSize = _size;
+            for (size_t _l = 0, _count = MipmapMap::chainLength(_size); _l < _count; _l++)
+            {
+                _levels.push_back({ _levelSize, _l, this });
+                _levelSize = MipmapMap::nextLevelSize(_levelSize);
+            }
+        }
+        virtual ~ProceduralMap() {}
+
+        virtual Color get(size_t _index) const override
+        {
+            return unpackTexel(fetch(0, static_cast<int>(_index % _size[0]), static_cast<int>(_index / _size[0])));
+        }
+
+        inline size_t getLevelCount() const
+        {
+            return _levels.size();
+        }
+        inline const ProceduralLevel& getLevel(size_t _level) const
+        {
+            return _levels[_level];
+        }
+
+        Texel fetch(size_t _level, int _x, int _y) const
+        {
+            static thread_local LocalCache _local;
+            uint64_t _key = (static_cast<uint64_t>(_level) << 48) |
+                (static_cast<uint64_t>(_y >> TILE_SHIFT) << 24) | static_cast<uint64_t>(_x >> TILE_SHIFT);
+            uint32_t _id = this->_id.load(std::memory_order_acquire);
+            auto& _entry = _local.entries[(_key ^ (_key >> 23) ^ (_key >> 47) ^ _id) & (LocalCache::ENTRIES - 1)];
+            if (_entry.id != _id || _entry.key != _key)
+            {
+                _entry.tile = _acquire(_level, _key);
+                _entry.id = _id;
+                _entry.key = _key;
+            }
+            return _entry.tile->texels[((_y & (TILE_SIZE - 1)) << TILE_SHIFT) | (_x & (TILE_SIZE - 1))];
+        }
+
+        // Drops every cached tile; the next fetches call the generator again
+        void invalidate()
+        {
+            std::lock_guard<std::mutex> _lock(_mutex);
+            _id.store(_nextId(), std::memory_order_release);
+            _tiles.clear();
+            _lru.clear();
+        }
+
+        inline size_t getCachedTileCount() const
+        {
+            std::lock_guard<std::mutex> _lock(_mutex);
+            return _tiles.size();
+        }
+        // Tiles generated so far, including ones regenerated after eviction
+        inline size_t getGeneratedTileCount() const
+        {
+            return _generated.load(std::memory_order_relaxed);
+        }
+
+        // Two-colour checkerboard with _cells squares across each axis; averages out once a
+        // texel covers a whole square
+        static Generator checker(const Color& _a, const Color& _b, int _cells)
+        {
+            return [=](const UVCoordinate& _uv, const UVCoordinate& _footprint)
+            {
+                if (max(_footprint[0], _footprint[1]) * _cells >= 1)
+                {
+                    return (_a + _b) * Float(0.5);
+                }
+                int _cx = static_cast<int>(std::floor(_uv[0] * _cells));
+                int _cy = static_cast<int>(std::floor(_uv[1] * _cells));
+                return ((_cx + _cy) & 1) ? _b : _a;
+            };
+        }
+        // Linear blend from _from at _start to _to at _end, clamped outside
+        static Generator gradient(const Color& _from, const Color& _to,
+                                  const UVCoordinate& _start = { 0, 0 }, const UVCoordinate& _end = { 0, 1 })
+        {
+            UVCoordinate _axis = _end - _start;
+            Float _length2 = max(_axis.squaredNorm(), Float(1e-12));
+            return [=](const UVCoordinate& _uv, const UVCoordinate&)
+            {
+                Float _t = (_uv - _start).dot(_axis) / _length2;
+                _t = _t < 0 ? 0 : (_t > 1 ? 1 : _t);
+                return _from * (1 - _t) + _to * _t;
+            };
+        }
+        // Smooth value noise with _cells lattice cells across each axis, blending _low to _high;
+        // fades to the mean where a texel spans more than one cell
+        static Generator noise(const Color& _low, const Color& _high, int _cells, uint32_t _seed = 0)
+        {
+            auto _hash = [_seed](int _x, int _y)
+            {
+                uint32_t _h = static_cast<uint32_t>(_x) * 0x8da6b343u ^ static_cast<uint32_t>(_y) * 0xd8163841u ^ _seed * 0xcb1ab31fu;
+                _h ^= _h >> 13;
+                _h *= 0x5bd1e995u;
+                _h ^= _h >> 15;
+                return static_cast<Float>(_h & 0xffff) / 0xffff;
+            };
+            return [=](const UVCoordinate& _uv, const UVCoordinate& _footprint)
+            {
+                Float _px = _uv[0] * _cells, _py = _uv[1] * _cells;
+                int _x0 = static_cast<int>(std::floor(_px)), _y0 = static_cast<int>(std::floor(_py));
+                Float _fx = _px - _x0, _fy = _py - _y0;
+                _fx = _fx * _fx * (3 - 2 * _fx);
+                _fy = _fy * _fy * (3 - 2 * _fy);
+                Float _top = _hash(_x0, _y0) + (_hash(_x0 + 1, _y0) - _hash(_x0, _y0)) * _fx;
+                Float _bottom = _hash(_x0, _y0 + 1) + (_hash(_x0 + 1, _y0 + 1) - _hash(_x0, _y0 + 1)) * _fx;
+                Float _value = _top + (_bottom - _top) * _fy;
+                Float _fade = max(_footprint[0], _footprint[1]) * _cells;
+                _fade = _fade > 1 ? 1 : _fade;
+                _value += (Float(0.5) - _value) * _fade;
+                return _low * (1 - _value) + _high * _value;
+            };
+        }
+
+    protected:
+        // Tags thread-local cache entries; never reused, so a stale entry can not match
+        inline static uint32_t _nextId()
+        {
+            static std::atomic<uint32_t> _next = 0;
+            return _next++;
+        }
+
+        std::shared_ptr<const Tile> _acquire(size_t _level, uint64_t _key) const
+        {
+            {
+                std::lock_guard<std::mutex> _lock(_mutex);
+                auto _found = _tiles.find(_key);
+                if (_found != _tiles.end())
+                {
+                    _lru.splice(_lru.begin(), _lru, _found->second.lru);
+                    return _found->second.tile;
+                }
+            }
+
+            // generated outside the lock; two threads racing for one tile both compute it
+            auto _tile = _generate(_level, static_cast<int>(_key & 0xffffff), static_cast<int>((_key >> 24) & 0xffffff));
+            std::lock_guard<std::mutex> _lock(_mutex);
+            auto [_it, _inserted] = _tiles.try_emplace(_key);
+            if (!_inserted)
+            {
+                _lru.splice(_lru.begin(), _lru, _it->second.lru);
+                return _it->second.tile;
+            }
+            _lru.push_front(_key);
+            _it->second = { _tile, _lru.begin() };
+            while (_tiles.size() > _maxTiles)
+            {
+                _tiles.erase(_lru.back());
+                _lru.pop_back();
+            }
+            return _tile;
+        }
+
+        std::shared_ptr<const Tile> _generate(size_t _level, int _tileX, int _tileY) const
+        {
+            auto _tile = std::make_shared<Tile>();
+            auto& _levelSize = _levels[_level].size;
+            UVCoordinate _footprint(Float(1) / _levelSize[0], Float(1) / _levelSize[1]);
+            for (int _y = 0; _y < TILE_SIZE; _y++)
+            {
+                int _py = min((_tileY << TILE_SHIFT) + _y, _levelSize[1] - 1);
+                for (int _x = 0; _x < TILE_SIZE; _x++)
+                {
+                    int _px = min((_tileX << TILE_SHIFT) + _x, _levelSize[0] - 1);
+                    UVCoordinate _uv((_px + Float(0.5)) * _footprint[0], (_py + Float(0.5)) * _footprint[1]);
+                    _tile->texels[(_y << TILE_SHIFT) | _x] = packTexel(_generator(_uv, _footprint));
+                }
+            }
+            _generated.fetch_add(1, std::memory_order_relaxed);
+            return _tile;
+        }
+    };
+
+    inline Texel ProceduralLevel::fetch(int _x, int _y) const
+    {
+        return map->fetch(level, _x, _y);
+    }
+};
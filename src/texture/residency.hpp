@@ -0,0 +1,178 @@
+#pragma once
+#include "streaming.hpp"
+
+namespace lightroom
+{
+    // Keeps streamed textures under a byte budget. Call endFrame() once per frame, after the
+    // frame's sampling is done: levels sampled that frame are stamped, levels that are wanted but
+    // evicted are streamed back in, and while over budget the finest levels that have been idle
+    // longest are dropped. The coarsest level of every texture is never evicted. A dropped level
+    // stays allocated until the fence passed with it is ready, as frames still in flight may
+    // sample it.
+    class TextureResidencyManager
+    {
+    protected:
+        struct Entry
+        {
+            std::weak_ptr<StreamingTexture> texture;
+            std::vector<uint64_t> lastUsed;     // frame each level was last sampled
+        };
+        struct Retired
+        {
+            std::shared_future<void> fence;     // ready once no frame can sample the level
+            std::unique_ptr<MipLevel> level;
+        };
+
+        TextureStreamer& _streamer;
+        size_t _budget;
+        uint64_t _idleFrames;
+
+        std::vector<Entry> _entries;
+        std::deque<Retired> _retired;
+        uint64_t _frame = 0;
+        size_t _residentBytes = 0;
+        size_t _evictions = 0;
+        size_t _reloads = 0;
+
+    public:
+        // _idleFrames: frames a level must go unsampled before it may be evicted
+        TextureResidencyManager(TextureStreamer& _streamer, size_t _budget, uint64_t _idleFrames = 30) :
+            _streamer(_streamer), _budget(_budget), _idleFrames(_idleFrames) {}
+        ~TextureResidencyManager()
+        {
+            for (auto& _retired : _retired)
+            {
+                if (_retired.fence.valid())
+                {
+                    _retired.fence.wait();
+                }
+            }
+        }
+
+        // Streams a texture in through the managed streamer and tracks it until it is released
+        std::shared_ptr<StreamingTexture> request(const std::filesystem::path& _fileName, Texel _placeholder = 0xff808080)
+        {
+            auto _texture = _streamer.request(_fileName, _placeholder);
+            if (_texture)
+            {
+                _entries.push_back({ _texture, std::vector<uint64_t>(_texture->getLevelCount(), _frame) });
+            }
+            return _texture;
+        }
+
+        // _inFlight: the newest frame submitted that may still be sampling, such as the future
+        // of the last renderAsync(); levels evicted now are freed once it is ready. Leave it
+        // empty when no frame is in flight (render() with one frame in flight, or after flush()).
+        // Frames finish in submission order, so this one fences every older frame as well.
+        void endFrame(std::shared_future<void> _inFlight = {})
+        {
+            _frame++;
+            while (!_retired.empty() && _isReady(_retired.front().fence))
+            {
+                _retired.pop_front();
+            }
+
+            _residentBytes = 0;
+            for (size_t _i = 0; _i < _entries.size();)
+            {
+                auto _texture = _entries[_i].texture.lock();
+                if (!_texture)
+                {
+                    _entries[_i] = std::move(_entries.back());
+                    _entries.pop_back();
+                    continue;
+                }
+                auto& _lastUsed = _entries[_i].lastUsed;
+                size_t _wanted = _texture->_takeWanted();
+                for (size_t _l = _wanted; _l < _lastUsed.size(); _l++)
+                {
+                    _lastUsed[_l] = _frame;
+                }
+                if (_wanted < _texture->getResidentLevel() && !_texture->isLoading() && !_texture->hasFailed())
+                {
+                    _streamer.reload(_texture, _wanted);
+                    _reloads++;
+                }
+                _residentBytes += _texture->getResidentBytes();
+                _i++;
+            }
+            if (_residentBytes > _budget)
+            {
+                _evictIdle(_inFlight);
+            }
+        }
+
+        inline size_t getBudget() const
+        {
+            return _budget;
+        }
+        inline void setBudget(size_t _bytes)
+        {
+            _budget = _bytes;
+        }
+        // As of the last endFrame(), after eviction
+        inline size_t getResidentBytes() const
+        {
+            return _residentBytes;
+        }
+        inline size_t getEvictionCount() const
+        {
+            return _evictions;
+        }
+        inline size_t getReloadCount() const
+        {
+            return _reloads;
+        }
+
+    protected:
+        inline static bool _isReady(const std::shared_future<void>& _fence)
+        {
+            return !_fence.valid() || _fence.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+        // Least recently used first; a texture's next finer candidate is only queued once its
+        // current finest level is gone, so eviction always peels levels from the fine end
+        void _evictIdle(const std::shared_future<void>& _inFlight)
+        {
+            using Candidate = std::pair<uint64_t, size_t>;  // last used frame, entry index
+            std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> _queue;
+            auto _consider = [&](size_t _i, const std::shared_ptr<StreamingTexture>& _texture)
+            {
+                if (!_texture)
+                {
+                    return;
+                }
+                size_t _level = _texture->getResidentLevel();
+                if (_level + 1 < _texture->getLevelCount() && !_texture->isLoading() &&
+                    _entries[_i].lastUsed[_level] + _idleFrames <= _frame)
+                {
+                    _queue.push({ _entries[_i].lastUsed[_level], _i });
+                }
+            };
+            for (size_t _i = 0; _i < _entries.size(); _i++)
+            {
+                _consider(_i, _entries[_i].texture.lock());
+            }
+
+            while (_residentBytes > _budget && !_queue.empty())
+            {
+                size_t _i = _queue.top().second;
+                _queue.pop();
+                auto _texture = _entries[_i].texture.lock();
+                if (!_texture)
+                {
+                    continue;
+                }
+                auto _level = _texture->_evict();
+                _residentBytes -= _level->texels.size() * sizeof(Texel);
+                // with nothing in flight the level goes at once
+                if (!_isReady(_inFlight))
+                {
+                    _retired.push_back({ _inFlight, std::move(_level) });
+                }
+                _evictions++;
+                _consider(_i, _texture);
+            }
+        }
+    };
+};
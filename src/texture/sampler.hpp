@@ -0,0 +1,354 @@
+#pragma once
+#include "texture_utility.hpp"
+
+namespace lightroom
+{
+    enum class TextureFilter : uint8_t
+    {
+        NEAREST, BILINEAR, TRILINEAR
+    };
+    enum class AddressMode : uint8_t
+    {
+        WRAP, CLAMP, MIRROR
+    };
+
+    class TextureMap;
+
+    class TextureSampler
+    {
+    public:
+        TextureFilter filter;
+        AddressMode addressU;
+        AddressMode addressV;
+        Float lodBias;
+
+        TextureSampler(TextureFilter filter = TextureFilter::TRILINEAR,
+                       AddressMode addressU = AddressMode::WRAP, AddressMode addressV = AddressMode::WRAP,
+                       Float lodBias = 0) :
+            filter(filter), addressU(addressU), addressV(addressV), lodBias(lodBias) {}
+
+        // Level of detail from the screen-space derivatives of the texture coordinates;
+        // negative values mean the texture is magnified
+        inline Float computeLod(const ColorMap& _map,
+                                const UVCoordinate& _dUVdx, const UVCoordinate& _dUVdy) const
+        {
+            Float _dx = std::hypot(_dUVdx[0] * _map.getWidth(), _dUVdx[1] * _map.getHeight());
+            Float _dy = std::hypot(_dUVdy[0] * _map.getWidth(), _dUVdy[1] * _map.getHeight());
+            Float _rho = max(_dx, _dy);
+            return _rho > 0 ? std::log2(_rho) + lodBias : lodBias;
+        }
+
+        // _Map is any mip chain exposing getLevelCount() and getLevel(i) with size and fetch(x, y).
+        // A type-erased TextureMap goes through its virtual sample instead.
+        inline Color sample(const TextureMap& _map, const UVCoordinate& _uv, Float _lod) const;
+        inline void sample8(const TextureMap& _map, const float* _u, const float* _v, Float _lod,
+                            Texel* _out) const;
+
+        template <typename _Map>
+        inline Color sample(const _Map& _map, const UVCoordinate& _uv,
+                            const UVCoordinate& _dUVdx, const UVCoordinate& _dUVdy) const
+        {
+            return sample(_map, _uv, computeLod(_map, _dUVdx, _dUVdy));
+        }
+        template <typename _Map>
+        inline Color sample(const _Map& _map, const UVCoordinate& _uv, Float _lod) const
+        {
+            Float _texel[4];
+            _sampleRaw(_map, _uv[0], _uv[1], _lod, _texel);
+            return Color(_texel[1] / 256, _texel[2] / 256, _texel[3] / 256, _texel[0] / 255);
+        }
+
+        // Samples eight coordinates at one level of detail and writes packed texels.
+        // Levels that expose their tiled texels directly are filtered with AVX2 gathers when
+        // CpuFeatures::getIsa() allows it; AVX-512 machines run the same kernel.
+        template <typename _Map>
+        inline void sample8(const _Map& _map, const float* _u, const float* _v, Float _lod,
+                            Texel* _out) const
+        {
+            if constexpr (requires { _map.getLevel(0).tiledTexels(); })
+            {
+                // all levels share one layout; the coarsest is the one that is always resident
+                if (CpuFeatures::getIsa() >= IsaLevel::AVX2 && _map.getLevel(_map.getLevelCount() - 1).tiledTexels())
+                {
+                    _sample8Avx2(_map, _u, _v, _lod, _out);
+                    return;
+                }
+            }
+            for (int _i = 0; _i < 8; _i++)
+            {
+                Float _texel[4];
+                _sampleRaw(_map, _u[_i], _v[_i], _lod, _texel);
+                _out[_i] = _packRaw(_texel);
+            }
+        }
+
+    private:
+        template <typename _Map>
+        inline Float _selectLevels(const _Map& _map, Float _lod, size_t& _fine, size_t& _coarse) const
+        {
+            Float _maxLevel = static_cast<Float>(_map.getLevelCount() - 1);
+            Float _minLevel = 0;
+            // streamed maps only expose the levels that have arrived so far
+            if constexpr (requires { _map.getResidentLevel(); })
+            {
+                _minLevel = static_cast<Float>(_map.getResidentLevel());
+            }
+            _lod = _lod < _minLevel ? _minLevel : (_lod > _maxLevel ? _maxLevel : _lod);
+            if (filter != TextureFilter::TRILINEAR)
+            {
+                _fine = _coarse = static_cast<size_t>(_lod + Float(0.5));
+                return 0;
+            }
+            _fine = static_cast<size_t>(_lod);
+            Float _t = _lod - _fine;
+            _coarse = _t > 0 ? _fine + 1 : _fine;
+            return _t;
+        }
+
+        // _out receives raw a, r, g, b channel values in [0, 255]
+        template <typename _Map>
+        inline void _sampleRaw(const _Map& _map, Float _u, Float _v, Float _lod, Float* _out) const
+        {
+            size_t _fine, _coarse;
+            Float _t = _selectLevels(_map, _lod, _fine, _coarse);
+            _filter(_map.getLevel(_fine), _u, _v, _out);
+            if (_coarse != _fine)
+            {
+                Float _next[4];
+                _filter(_map.getLevel(_coarse), _u, _v, _next);
+                for (int _c = 0; _c < 4; _c++)
+                {
+                    _out[_c] += (_next[_c] - _out[_c]) * _t;
+                }
+            }
+        }
+
+        inline static Texel _packRaw(const Float* _raw)
+        {
+            Texel _t = 0;
+            for (int _c = 0; _c < 4; _c++)
+            {
+                _t |= static_cast<Texel>(_raw[_c] + Float(0.5)) << (24 - 8 * _c);
+            }
+            return _t;
+        }
+        inline static void _unpackRaw(Texel _t, Float* _out, Float _weight = 1)
+        {
+            _out[0] += _weight * (_t >> 24);
+            _out[1] += _weight * ((_t >> 16) & 0xff);
+            _out[2] += _weight * ((_t >> 8) & 0xff);
+            _out[3] += _weight * (_t & 0xff);
+        }
+
+        inline static int _address(int _i, int _size, AddressMode _mode)
+        {
+            bool _pow2 = (_size & (_size - 1)) == 0;
+            switch (_mode)
+            {
+                case AddressMode::CLAMP:
+                    return _i < 0 ? 0 : (_i >= _size ? _size - 1 : _i);
+                case AddressMode::MIRROR:
+                {
+                    int _period = 2 * _size;
+                    int _m = _pow2 ? (_i & (_period - 1)) : ((_i % _period) + _period) % _period;
+                    return _m < _size ? _m : _period - 1 - _m;
+                }
+                case AddressMode::WRAP:
+                default:
+                    return _pow2 ? (_i & (_size - 1)) : ((_i % _size) + _size) % _size;
+            }
+        }
+
+        template <typename _Level>
+        inline void _filter(const _Level& _level, Float _u, Float _v, Float* _out) const
+        {
+            _out[0] = _out[1] = _out[2] = _out[3] = 0;
+            int _w = _level.size[0], _h = _level.size[1];
+            if (filter == TextureFilter::NEAREST)
+            {
+                _unpackRaw(_level.fetch(_address(static_cast<int>(std::floor(_u * _w)), _w, addressU),
+                                        _address(static_cast<int>(std::floor(_v * _h)), _h, addressV)), _out);
+                return;
+            }
+
+            Float _fx = _u * _w - Float(0.5);
+            Float _fy = _v * _h - Float(0.5);
+            Float _x0f = std::floor(_fx), _y0f = std::floor(_fy);
+            Float _tx = _fx - _x0f, _ty = _fy - _y0f;
+            int _x0 = _address(static_cast<int>(_x0f), _w, addressU);
+            int _x1 = _address(static_cast<int>(_x0f) + 1, _w, addressU);
+            int _y0 = _address(static_cast<int>(_y0f), _h, addressV);
+            int _y1 = _address(static_cast<int>(_y0f) + 1, _h, addressV);
+
+            _unpackRaw(_level.fetch(_x0, _y0), _out, (1 - _tx) * (1 - _ty));
+            _unpackRaw(_level.fetch(_x1, _y0), _out, _tx * (1 - _ty));
+            _unpackRaw(_level.fetch(_x0, _y1), _out, (1 - _tx) * _ty);
+            _unpackRaw(_level.fetch(_x1, _y1), _out, _tx * _ty);
+        }
+
+        template <typename _Map>
+        LIGHTROOM_TARGET("avx2") inline void _sample8Avx2(const _Map& _map, const float* _u, const float* _v, Float _lod,
+                                                          Texel* _out) const
+        {
+            __m256 _vu = _mm256_loadu_ps(_u), _vv = _mm256_loadu_ps(_v);
+            size_t _fine, _coarse;
+            Float _t = _selectLevels(_map, _lod, _fine, _coarse);
+            __m256 _acc[4], _acc2[4];
+            _filter8(_map.getLevel(_fine), _vu, _vv, _acc);
+            if (_coarse != _fine)
+            {
+                _filter8(_map.getLevel(_coarse), _vu, _vv, _acc2);
+                __m256 _vt = _mm256_set1_ps(static_cast<float>(_t));
+                for (int _c = 0; _c < 4; _c++)
+                {
+                    _acc[_c] = _mm256_add_ps(_acc[_c], _mm256_mul_ps(_mm256_sub_ps(_acc2[_c], _acc[_c]), _vt));
+                }
+            }
+            __m256i _packed = _mm256_setzero_si256();
+            for (int _c = 0; _c < 4; _c++)
+            {
+                __m256i _ch = _mm256_cvtps_epi32(_acc[_c]);
+                _packed = _mm256_or_si256(_packed, _mm256_slli_epi32(_ch, 24 - 8 * _c));
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out), _packed);
+        }
+        // _i mod _n in [0, _n) for any int _i. The quotient is taken in double, where every int
+        // is exact, so it is off by at most one; the remainder is then stepped back into range.
+        LIGHTROOM_TARGET("avx2") inline static __m256i _mod8(__m256i _i, int _n)
+        {
+            __m256d _d = _mm256_set1_pd(static_cast<double>(_n));
+            __m128i _lo = _mm256_cvttpd_epi32(_mm256_floor_pd(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(_i)), _d)));
+            __m128i _hi = _mm256_cvttpd_epi32(_mm256_floor_pd(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(_i, 1)), _d)));
+            __m256i _n8 = _mm256_set1_epi32(_n);
+            __m256i _r = _mm256_sub_epi32(_i, _mm256_mullo_epi32(_mm256_set_m128i(_hi, _lo), _n8));
+            _r = _mm256_add_epi32(_r, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), _r), _n8));
+            return _mm256_sub_epi32(_r, _mm256_andnot_si256(_mm256_cmpgt_epi32(_n8, _r), _n8));
+        }
+        LIGHTROOM_TARGET("avx2") inline static __m256i _address8(__m256i _i, int _size, AddressMode _mode)
+        {
+            bool _pow2 = (_size & (_size - 1)) == 0;
+            switch (_mode)
+            {
+                case AddressMode::CLAMP:
+                    return _mm256_min_epi32(_mm256_max_epi32(_i, _mm256_setzero_si256()), _mm256_set1_epi32(_size - 1));
+                case AddressMode::MIRROR:
+                {
+                    int _period = 2 * _size;
+                    __m256i _m = _pow2 ? _mm256_and_si256(_i, _mm256_set1_epi32(_period - 1)) : _mod8(_i, _period);
+                    __m256i _back = _mm256_cmpgt_epi32(_m, _mm256_set1_epi32(_size - 1));
+                    return _mm256_blendv_epi8(_m, _mm256_sub_epi32(_mm256_set1_epi32(_period - 1), _m), _back);
+                }
+                case AddressMode::WRAP:
+                default:
+                    return _pow2 ? _mm256_and_si256(_i, _mm256_set1_epi32(_size - 1)) : _mod8(_i, _size);
+            }
+        }
+        // Tiled addressing of MipLevel: row-major 8x8 tiles, Morton order inside each tile
+        LIGHTROOM_TARGET("avx2") inline static __m256i _tileOffsetX8(__m256i _x)
+        {
+            const __m256i _spread = _mm256_setr_epi32(0, 1, 4, 5, 16, 17, 20, 21);
+            __m256i _inner = _mm256_permutevar8x32_epi32(_spread, _mm256_and_si256(_x, _mm256_set1_epi32(MipLevel::TILE_SIZE - 1)));
+            return _mm256_add_epi32(_mm256_slli_epi32(_mm256_srli_epi32(_x, MipLevel::TILE_SHIFT), 2 * MipLevel::TILE_SHIFT), _inner);
+        }
+        template <typename _Level>
+        LIGHTROOM_TARGET("avx2") inline static __m256i _tileBase8(const _Level& _level, __m256i _y)
+        {
+            const __m256i _spread = _mm256_setr_epi32(0, 2, 8, 10, 32, 34, 40, 42);
+            __m256i _inner = _mm256_permutevar8x32_epi32(_spread, _mm256_and_si256(_y, _mm256_set1_epi32(MipLevel::TILE_SIZE - 1)));
+            __m256i _row = _mm256_mullo_epi32(_mm256_srli_epi32(_y, MipLevel::TILE_SHIFT), _mm256_set1_epi32(_level.tilesX));
+            return _mm256_add_epi32(_mm256_slli_epi32(_row, 2 * MipLevel::TILE_SHIFT), _inner);
+        }
+        template <typename _Level>
+        LIGHTROOM_TARGET("avx2") inline static __m256i _index8(const _Level& _level, __m256i _x, __m256i _y)
+        {
+            return _mm256_add_epi32(_tileBase8(_level, _y), _tileOffsetX8(_x));
+        }
+        LIGHTROOM_TARGET("avx2") inline static void _accumulate8(__m256i _texels, __m256 _weight, __m256* _acc)
+        {
+            const __m256i _mask = _mm256_set1_epi32(0xff);
+            for (int _c = 0; _c < 4; _c++)
+            {
+                __m256 _ch = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(_texels, 24 - 8 * _c), _mask));
+                _acc[_c] = _mm256_add_ps(_acc[_c], _mm256_mul_ps(_ch, _weight));
+            }
+        }
+        template <typename _Level>
+        LIGHTROOM_TARGET("avx2") inline void _filter8(const _Level& _level, __m256 _u, __m256 _v, __m256* _acc) const
+        {
+            auto _base = reinterpret_cast<const int*>(_level.tiledTexels());
+            int _w = _level.size[0], _h = _level.size[1];
+            __m256 _vw = _mm256_set1_ps(static_cast<float>(_w)), _vh = _mm256_set1_ps(static_cast<float>(_h));
+            for (int _c = 0; _c < 4; _c++)
+            {
+                _acc[_c] = _mm256_setzero_ps();
+            }
+
+            if (filter == TextureFilter::NEAREST)
+            {
+                __m256i _x = _address8(_mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_u, _vw))), _w, addressU);
+                __m256i _y = _address8(_mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_v, _vh))), _h, addressV);
+                __m256i _t = _mm256_i32gather_epi32(_base, _index8(_level, _x, _y), 4);
+                _accumulate8(_t, _mm256_set1_ps(1), _acc);
+                return;
+            }
+
+            const __m256 _half = _mm256_set1_ps(0.5f), _one = _mm256_set1_ps(1);
+            __m256 _fx = _mm256_sub_ps(_mm256_mul_ps(_u, _vw), _half);
+            __m256 _fy = _mm256_sub_ps(_mm256_mul_ps(_v, _vh), _half);
+            __m256 _x0f = _mm256_floor_ps(_fx), _y0f = _mm256_floor_ps(_fy);
+            __m256 _tx = _mm256_sub_ps(_fx, _x0f), _ty = _mm256_sub_ps(_fy, _y0f);
+            __m256i _x0i = _mm256_cvttps_epi32(_x0f), _y0i = _mm256_cvttps_epi32(_y0f);
+            __m256i _x0 = _address8(_x0i, _w, addressU);
+            __m256i _x1 = _address8(_mm256_add_epi32(_x0i, _mm256_set1_epi32(1)), _w, addressU);
+            __m256i _y0 = _address8(_y0i, _h, addressV);
+            __m256i _y1 = _address8(_mm256_add_epi32(_y0i, _mm256_set1_epi32(1)), _h, addressV);
+
+            __m256 _sx = _mm256_sub_ps(_one, _tx), _sy = _mm256_sub_ps(_one, _ty);
+            _accumulate8(_mm256_i32gather_epi32(_base, _index8(_level, _x0, _y0), 4), _mm256_mul_ps(_sx, _sy), _acc);
+            _accumulate8(_mm256_i32gather_epi32(_base, _index8(_level, _x1, _y0), 4), _mm256_mul_ps(_tx, _sy), _acc);
+            _accumulate8(_mm256_i32gather_epi32(_base, _index8(_level, _x0, _y1), 4), _mm256_mul_ps(_sx, _ty), _acc);
+            _accumulate8(_mm256_i32gather_epi32(_base, _index8(_level, _x1, _y1), 4), _mm256_mul_ps(_tx, _ty), _acc);
+        }
+    };
+
+    // Any mip-mapped texture, sampled through one virtual call per pixel so that
+    // vertices and materials can refer to textures of different storage types
+    class TextureMap : public ColorMap
+    {
+    public:
+        TextureMap(const PxCoordinate& _size) : ColorMap(_size) {}
+        virtual ~TextureMap() {}
+
+        virtual Color sample(const TextureSampler& _sampler, const UVCoordinate& _uv, Float _lod) const = 0;
+        virtual void sample8(const TextureSampler& _sampler, const float* _u, const float* _v, Float _lod,
+                             Texel* _out) const = 0;
+    };
+
+    // Implements TextureMap's virtual sampling with the sampler's statically dispatched path
+    template <typename _Derived>
+    class TextureMapBase : public TextureMap
+    {
+    public:
+        TextureMapBase(const PxCoordinate& _size) : TextureMap(_size) {}
+
+        virtual Color sample(const TextureSampler& _sampler, const UVCoordinate& _uv, Float _lod) const override
+        {
+            return _sampler.sample(static_cast<const _Derived&>(*this), _uv, _lod);
+        }
+        virtual void sample8(const TextureSampler& _sampler, const float* _u, const float* _v, Float _lod,
+                             Texel* _out) const override
+        {
+            _sampler.sample8(static_cast<const _Derived&>(*this), _u, _v, _lod, _out);
+        }
+    };
+
+    inline Color TextureSampler::sample(const TextureMap& _map, const UVCoordinate& _uv, Float _lod) const
+    {
+        return _map.sample(*this, _uv, _lod);
+    }
+    inline void TextureSampler::sample8(const TextureMap& _map, const float* _u, const float* _v, Float _lod,
+                                        Texel* _out) const
+    {
+        _map.sample8(*this, _u, _v, _lod, _out);
+    }
+};
@@ -0,0 +1,327 @@
+#pragma once
+#include "mipmap.hpp"
+#include "image_loader.hpp"
+#include "texture_file.hpp"
+
+namespace lightroom
+{
+    // Texture whose mip levels arrive in the background, coarsest first. Until the first level
+    // lands it samples as a flat placeholder; afterwards the sampler clamps to resident levels.
+    // Fine levels may later be evicted and streamed back in (see TextureResidencyManager).
+    class StreamingTexture : public TextureMap
+    {
+        friend class TextureStreamer;
+        friend class TextureResidencyManager;
+
+    protected:
+        // A slot keeps pointing at an evicted level until it is reloaded, so a reader that saw the
+        // old resident index still finds live texels; the evicted level is freed frames later.
+        std::vector<std::atomic<MipLevel*>> _slots;
+        std::atomic<size_t> _resident;      // finest level readers may touch; getLevelCount() when none
+        mutable std::atomic<size_t> _wanted;    // finest level sampled since the last _takeWanted()
+        std::atomic<bool> _loading = true;
+        std::atomic<bool> _failed = false;
+        Texel _placeholder;
+
+        std::filesystem::path _fileName;
+        std::shared_ptr<MappedTexture> _container;  // kept mapped so evicted levels reload without a decode
+
+    public:
+        StreamingTexture(const PxCoordinate& _size, size_t _levelCount, Texel _placeholder = 0xff808080) :
+            TextureMap(_size), _slots(_levelCount), _resident(_levelCount), _wanted(_levelCount),
+            _placeholder(_placeholder) {}
+        virtual ~StreamingTexture()
+        {
+            for (size_t _l = getResidentLevel(); _l < _slots.size(); _l++)
+            {
+                delete _slots[_l].load();
+            }
+        }
+
+        virtual Color get(size_t _index) const override
+        {
+            _noteWanted(0);
+            size_t _level = getResidentLevel();
+            if (_level == _slots.size())
+            {
+                return unpackTexel(_placeholder);
+            }
+            auto& _l = getLevel(_level);
+            return unpackTexel(_l.fetch(min(static_cast<int>(_index % _size[0]) >> _level, _l.size[0] - 1),
+                                        min(static_cast<int>(_index / _size[0]) >> _level, _l.size[1] - 1)));
+        }
+
+        virtual Color sample(const TextureSampler& _sampler, const UVCoordinate& _uv, Float _lod) const override
+        {
+            _noteWanted(_lod);
+            if (getResidentLevel() == _slots.size())
+            {
+                return unpackTexel(_placeholder);
+            }
+            return _sampler.sample(*this, _uv, _lod);
+        }
+        virtual void sample8(const TextureSampler& _sampler, const float* _u, const float* _v, Float _lod,
+                             Texel* _out) const override
+        {
+            _noteWanted(_lod);
+            if (getResidentLevel() == _slots.size())
+            {
+                std::fill(_out, _out + 8, _placeholder);
+                return;
+            }
+            _sampler.sample8(*this, _u, _v, _lod, _out);
+        }
+
+        inline size_t getLevelCount() const
+        {
+            return _slots.size();
+        }
+        // Valid for levels from getResidentLevel() on; the loader publishes each one through its
+        // atomic slot before lowering _resident, so raster threads never see a level being filled
+        inline const MipLevel& getLevel(size_t _level) const
+        {
+            return *_slots[_level].load(std::memory_order_acquire);
+        }
+        inline size_t getResidentLevel() const
+        {
+            return _resident.load(std::memory_order_acquire);
+        }
+        inline bool isComplete() const
+        {
+            return getResidentLevel() == 0;
+        }
+        inline bool isLoading() const
+        {
+            return _loading.load(std::memory_order_acquire);
+        }
+        inline bool hasFailed() const
+        {
+            return _failed;
+        }
+        // Bytes held by resident levels
+        size_t getResidentBytes() const
+        {
+            size_t _bytes = 0;
+            for (size_t _l = getResidentLevel(); _l < _slots.size(); _l++)
+            {
+                _bytes += getLevel(_l).texels.size() * sizeof(Texel);
+            }
+            return _bytes;
+        }
+
+    protected:
+        // A usage hint only: a lost race between samplers just records a slightly coarser level
+        inline void _noteWanted(Float _lod) const
+        {
+            size_t _level = _lod <= 0 ? 0 : min(static_cast<size_t>(_lod), _slots.size() - 1);
+            if (_level < _wanted.load(std::memory_order_relaxed))
+            {
+                _wanted.store(_level, std::memory_order_relaxed);
+            }
+        }
+        inline size_t _takeWanted()
+        {
+            return _wanted.exchange(_slots.size(), std::memory_order_relaxed);
+        }
+
+        // Levels must arrive in order, each one finer than the last
+        inline void _publish(size_t _level, MipLevel&& _texels)
+        {
+            _slots[_level].store(new MipLevel(std::move(_texels)), std::memory_order_release);
+            _resident.store(_level, std::memory_order_release);
+        }
+        // Hands the finest resident level to the caller, who must keep it alive while frames
+        // that started before the eviction may still sample it
+        inline std::unique_ptr<MipLevel> _evict()
+        {
+            size_t _level = getResidentLevel();
+            _resident.store(_level + 1, std::memory_order_release);
+            return std::unique_ptr<MipLevel>(_slots[_level].load(std::memory_order_relaxed));
+        }
+    };
+
+    // Background loader for StreamingTexture. request() only reads the file header; decoding,
+    // mip generation and copying out of .lrtex containers run as background jobs on the job
+    // system, at most _maxLoads at a time so that streaming never takes over the whole pool.
+    class TextureStreamer
+    {
+    protected:
+        struct Request
+        {
+            std::shared_ptr<StreamingTexture> texture;
+            size_t finest;
+        };
+
+        JobSystem& _jobs;
+        unsigned _maxLoads;
+        std::deque<Request> _queue;
+        mutable std::mutex _mutex;
+        std::condition_variable _idle;
+        bool _stopping = false;
+        size_t _busy = 0;       // requests being loaded
+        unsigned _loaders = 0;  // jobs draining the queue
+
+    public:
+        TextureStreamer(unsigned _maxLoads = 1, JobSystem& _jobs = JobSystem::getDefault()) :
+            _jobs(_jobs), _maxLoads(max(1u, _maxLoads)) {}
+        // Requests still queued are dropped; their textures keep whatever levels they have.
+        // Loads in progress are finished first.
+        ~TextureStreamer()
+        {
+            std::unique_lock<std::mutex> _lock(_mutex);
+            _stopping = true;
+            for (auto& _request : _queue)
+            {
+                _request.texture->_loading.store(false, std::memory_order_release);
+            }
+            _queue.clear();
+            _idle.wait(_lock, [this]() { return _loaders == 0; });
+        }
+
+        // Accepts .lrtex containers, PNG and JPEG. Returns at once; nullptr if the header is unreadable.
+        std::shared_ptr<StreamingTexture> request(const std::filesystem::path& _fileName, Texel _placeholder = 0xff808080)
+        {
+            std::shared_ptr<MappedTexture> _container = MappedTexture::open(_fileName);
+            std::shared_ptr<StreamingTexture> _texture;
+            if (_container)
+            {
+                _texture = std::make_shared<StreamingTexture>(
+                    PxCoordinate{ _container->getWidth(), _container->getHeight() },
+                    _container->getLevelCount(), _placeholder);
+            }
+            else
+            {
+                PxCoordinate _size;
+                if (!ImageLoader::probe(_fileName, _size))
+                {
+                    return nullptr;
+                }
+                _texture = std::make_shared<StreamingTexture>(_size, MipmapMap::chainLength(_size), _placeholder);
+            }
+            _texture->_fileName = _fileName;
+            _texture->_container = std::move(_container);
+            _enqueue({ _texture, 0 });
+            return _texture;
+        }
+
+        // Streams evicted levels back in, down to _finest. Ignored while the texture is still loading.
+        void reload(const std::shared_ptr<StreamingTexture>& _texture, size_t _finest)
+        {
+            if (_finest >= _texture->getResidentLevel() || _texture->_loading.exchange(true))
+            {
+                return;
+            }
+            _enqueue({ _texture, _finest });
+        }
+
+        // Requests queued or being loaded
+        inline size_t getPendingCount() const
+        {
+            std::lock_guard<std::mutex> _lock(_mutex);
+            return _queue.size() + _busy;
+        }
+
+    protected:
+        void _enqueue(Request&& _request)
+        {
+            {
+                std::lock_guard<std::mutex> _lock(_mutex);
+                _queue.push_back(std::move(_request));
+                if (_loaders >= _maxLoads)
+                {
+                    return;
+                }
+                _loaders++;
+            }
+            // outside the lock: a pool without workers runs the loader right here, and it locks _mutex
+            _jobs.submitBackground([this]() { _drain(); });
+        }
+
+        // One loader job: takes one request, then hands the worker back and queues itself again
+        // while requests remain, so frame work is never stuck behind a whole queue of decodes
+        void _drain()
+        {
+            for (;;)
+            {
+                Request _request;
+                {
+                    std::lock_guard<std::mutex> _lock(_mutex);
+                    if (_stopping || _queue.empty())
+                    {
+                        _loaders--;
+                        _idle.notify_all();
+                        return;
+                    }
+                    _request = std::move(_queue.front());
+                    _queue.pop_front();
+                    _busy++;
+                }
+                if (!_load(*_request.texture, _request.finest))
+                {
+                    _request.texture->_failed = true;
+                }
+                _request.texture->_loading.store(false, std::memory_order_release);
+                {
+                    std::lock_guard<std::mutex> _lock(_mutex);
+                    _busy--;
+                    if (_stopping || _queue.empty())
+                    {
+                        _loaders--;
+                        _idle.notify_all();
+                        return;
+                    }
+                }
+                // a pool without workers has nobody to hand over to
+                if (_jobs.getThreadCount())
+                {
+                    _jobs.submitBackground([this]() { _drain(); });
+                    return;
+                }
+            }
+        }
+
+        // Publishes every level from just above the resident one down to _finest
+        bool _load(StreamingTexture& _texture, size_t _finest)
+        {
+            size_t _from = _texture.getResidentLevel();
+            if (_texture._container)
+            {
+                auto& _source = *_texture._container;
+                for (size_t _l = _from; _l-- > _finest;)
+                {
+                    auto& _src = _source.getLevel(_l);
+                    MipLevel _dst(_src.size);
+                    if (auto _texels = _src.tiledTexels())
+                    {
+                        memcpy(_dst.texels.data(), _texels, _dst.texels.size() * sizeof(Texel));
+                    }
+                    else
+                    {
+                        for (int _y = 0; _y < _src.size[1]; _y++)
+                        {
+                            for (int _x = 0; _x < _src.size[0]; _x++)
+                            {
+                                _dst.store(_x, _y, _src.fetch(_x, _y));
+                            }
+                        }
+                    }
+                    _texture._publish(_l, std::move(_dst));
+                }
+                return true;
+            }
+
+            auto _image = ImageLoader(1).load(_texture._fileName);
+            if (!_image || _image->getWidth() != _texture.getWidth() || _image->getHeight() != _texture.getHeight())
+            {
+                return false;
+            }
+            auto _chain = MipmapMap::buildChain(MipmapMap::tileImage(*_image));
+            _image.reset();
+            for (size_t _l = _from; _l-- > _finest;)
+            {
+                _texture._publish(_l, std::move(_chain[_l]));
+            }
+            return true;
+        }
+    };
+};
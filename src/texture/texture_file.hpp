@@ -0,0 +1,272 @@
+#pragma once
+#include "block_compression.hpp"
+
+namespace lightroom
+{
+    // Payload encodings of a .lrtex file
+    enum class TexelFormat : uint32_t
+    {
+        ARGB8_TILED,    // MipLevel layout: 8x8 tiles, Morton order inside a tile
+        BC1,
+        BC3
+    };
+
+    // On-disk header of a .lrtex file. Level payloads follow at 64-byte aligned
+    // offsets, so a mapped file can be sampled in place without any parsing.
+    struct TextureFileHeader
+    {
+        static constexpr uint32_t MAGIC = 0x5854524c;   // "LRTX"
+        static constexpr uint32_t VERSION = 1;
+        static constexpr uint32_t MAX_LEVELS = 16;
+        static constexpr uint64_t ALIGNMENT = 64;
+
+        struct Level
+        {
+            uint32_t width;
+            uint32_t height;
+            uint64_t offset;
+            uint64_t bytes;
+        };
+
+        uint32_t magic;
+        uint32_t version;
+        TexelFormat format;
+        uint32_t levelCount;
+        uint32_t width;
+        uint32_t height;
+        uint32_t tileSize;
+        uint32_t reserved;
+        Level levels[MAX_LEVELS];
+    };
+
+    // Read-only view of a whole file; pages are shared with every other process mapping it
+    class MappedFile
+    {
+    protected:
+        const uint8_t* _data = nullptr;
+        size_t _bytes = 0;
+        HANDLE _file = INVALID_HANDLE_VALUE;
+        HANDLE _mapping = nullptr;
+
+    public:
+        MappedFile(const std::filesystem::path& _fileName)
+        {
+            _file = CreateFileW(_fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            LARGE_INTEGER _size;
+            if (_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(_file, &_size) || _size.QuadPart == 0)
+            {
+                return;
+            }
+            _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (_mapping)
+            {
+                _data = static_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+                _bytes = _data ? static_cast<size_t>(_size.QuadPart) : 0;
+            }
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile()
+        {
+            if (_data)
+            {
+                UnmapViewOfFile(_data);
+            }
+            if (_mapping)
+            {
+                CloseHandle(_mapping);
+            }
+            if (_file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(_file);
+            }
+        }
+
+        inline const uint8_t* data() const
+        {
+            return _data;
+        }
+        inline size_t size() const
+        {
+            return _bytes;
+        }
+    };
+
+    // One mip level pointing straight into a mapped payload
+    struct MappedMipLevel
+    {
+        PxCoordinate size;
+        TexelFormat format;
+        int tilesX;
+        int blocksX;
+        const uint8_t* payload;
+        uint32_t id;
+
+        inline Texel fetch(int _x, int _y) const
+        {
+            switch (format)
+            {
+            case TexelFormat::BC1:
+                return fetchBlockTexel(BlockFormat::BC1, payload, blocksX, id, _x, _y);
+            case TexelFormat::BC3:
+                return fetchBlockTexel(BlockFormat::BC3, payload, blocksX, id, _x, _y);
+            default:
+                return tiledTexels()[MipLevel::tiledIndex(tilesX, _x, _y)];
+            }
+        }
+        // Tiled levels are filtered with gathers straight from the mapping
+        inline const Texel* tiledTexels() const
+        {
+            return format == TexelFormat::ARGB8_TILED ? reinterpret_cast<const Texel*>(payload) : nullptr;
+        }
+
+        // Payload size of a level of this format; 64-bit throughout, as the sizes may come
+        // straight from an unchecked header
+        inline static uint64_t byteSize(TexelFormat _format, uint64_t _width, uint64_t _height)
+        {
+            if (_format == TexelFormat::ARGB8_TILED)
+            {
+                uint64_t _tile = MipLevel::TILE_SIZE;
+                return ((_width + _tile - 1) / _tile) * ((_height + _tile - 1) / _tile) *
+                    MipLevel::TILE_TEXELS * sizeof(Texel);
+            }
+            return ((_width + 3) / 4) * ((_height + 3) / 4) *
+                blockBytes(_format == TexelFormat::BC1 ? BlockFormat::BC1 : BlockFormat::BC3);
+        }
+    };
+
+    // Texture sampled in place from a memory-mapped .lrtex file: opening it costs
+    // a header check, and texels are paged in on first touch
+    class MappedTexture : public TextureMapBase<MappedTexture>
+    {
+    protected:
+        std::unique_ptr<MappedFile> _file;
+        TexelFormat _format;
+        std::vector<MappedMipLevel> _levels;
+
+        MappedTexture(std::unique_ptr<MappedFile>&& _file, const TextureFileHeader& _header) :
+            TextureMapBase(PxCoordinate{ static_cast<int>(_header.width), static_cast<int>(_header.height) }),
+            _file(std::move(_file)), _format(_header.format)
+        {
+            for (uint32_t _l = 0; _l < _header.levelCount; _l++)
+            {
+                auto& _level = _header.levels[_l];
+                PxCoordinate _levelSize{ static_cast<int>(_level.width), static_cast<int>(_level.height) };
+                _levels.push_back({ _levelSize, _format, MipLevel::tileCount(_levelSize[0]), (_levelSize[0] + 3) / 4,
+                                    this->_file->data() + _level.offset, newBlockPayloadId() });
+            }
+        }
+
+    public:
+        virtual ~MappedTexture() {}
+
+        // Returns nullptr if the file is missing, truncated or not a version 1 container
+        static std::unique_ptr<MappedTexture> open(const std::filesystem::path& _fileName)
+        {
+            auto _file = std::make_unique<MappedFile>(_fileName);
+            if (_file->size() < sizeof(TextureFileHeader))
+            {
+                return nullptr;
+            }
+            TextureFileHeader _header;
+            memcpy(&_header, _file->data(), sizeof(_header));
+            if (_header.magic != TextureFileHeader::MAGIC || _header.version != TextureFileHeader::VERSION ||
+                _header.format > TexelFormat::BC3 || _header.levelCount == 0 ||
+                _header.levelCount > TextureFileHeader::MAX_LEVELS ||
+                _header.width != _header.levels[0].width || _header.height != _header.levels[0].height)
+            {
+                return nullptr;
+            }
+            for (uint32_t _l = 0; _l < _header.levelCount; _l++)
+            {
+                auto& _level = _header.levels[_l];
+                // dimensions are bounded so that coordinates and tile counts stay within int
+                if (_level.width == 0 || _level.height == 0 || _level.width > INT_MAX / 2 || _level.height > INT_MAX / 2 ||
+                    _level.offset % TextureFileHeader::ALIGNMENT ||
+                    _level.bytes != MappedMipLevel::byteSize(_header.format, _level.width, _level.height) ||
+                    _level.offset > _file->size() || _level.bytes > _file->size() - _level.offset)
+                {
+                    return nullptr;
+                }
+            }
+            return std::unique_ptr<MappedTexture>(new MappedTexture(std::move(_file), _header));
+        }
+
+        virtual Color get(size_t _index) const override
+        {
+            return unpackTexel(_levels[0].fetch(static_cast<int>(_index % _size[0]),
+                                                static_cast<int>(_index / _size[0])));
+        }
+
+        inline TexelFormat getFormat() const
+        {
+            return _format;
+        }
+        inline size_t getLevelCount() const
+        {
+            return _levels.size();
+        }
+        inline const MappedMipLevel& getLevel(size_t _level) const
+        {
+            return _levels[_level];
+        }
+    };
+
+    // Writes .lrtex containers from textures already built in memory
+    class TextureFile
+    {
+    public:
+        static bool write(const std::filesystem::path& _fileName, const MipmapMap& _texture)
+        {
+            std::vector<const uint8_t*> _payloads;
+            for (size_t _l = 0; _l < _texture.getLevelCount(); _l++)
+            {
+                _payloads.push_back(reinterpret_cast<const uint8_t*>(_texture.getLevel(_l).tiledTexels()));
+            }
+            return _write(_fileName, TexelFormat::ARGB8_TILED, _texture, _payloads);
+        }
+        static bool write(const std::filesystem::path& _fileName, const BlockCompressedMap& _texture)
+        {
+            std::vector<const uint8_t*> _payloads;
+            for (size_t _l = 0; _l < _texture.getLevelCount(); _l++)
+            {
+                _payloads.push_back(_texture.getLevel(_l).blocks.data());
+            }
+            return _write(_fileName, _texture.getFormat() == BlockFormat::BC1 ? TexelFormat::BC1 : TexelFormat::BC3,
+                          _texture, _payloads);
+        }
+
+    protected:
+        template <typename _Map>
+        static bool _write(const std::filesystem::path& _fileName, TexelFormat _format, const _Map& _texture,
+                           const std::vector<const uint8_t*>& _payloads)
+        {
+            TextureFileHeader _header{ TextureFileHeader::MAGIC, TextureFileHeader::VERSION, _format,
+                static_cast<uint32_t>((std::min)(_payloads.size(), static_cast<size_t>(TextureFileHeader::MAX_LEVELS))),
+                static_cast<uint32_t>(_texture.getWidth()), static_cast<uint32_t>(_texture.getHeight()),
+                static_cast<uint32_t>(MipLevel::TILE_SIZE), 0 };
+            uint64_t _offset = sizeof(TextureFileHeader);
+            for (uint32_t _l = 0; _l < _header.levelCount; _l++)
+            {
+                auto& _size = _texture.getLevel(_l).size;
+                _offset = (_offset + TextureFileHeader::ALIGNMENT - 1) & ~(TextureFileHeader::ALIGNMENT - 1);
+                _header.levels[_l] = { static_cast<uint32_t>(_size[0]), static_cast<uint32_t>(_size[1]),
+                                       _offset, MappedMipLevel::byteSize(_format, _size[0], _size[1]) };
+                _offset += _header.levels[_l].bytes;
+            }
+
+            std::ofstream _file(_fileName, std::ios::binary);
+            _file.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+            uint64_t _written = sizeof(_header);
+            const char _padding[TextureFileHeader::ALIGNMENT]{};
+            for (uint32_t _l = 0; _l < _header.levelCount; _l++)
+            {
+                _file.write(_padding, _header.levels[_l].offset - _written);
+                _file.write(reinterpret_cast<const char*>(_payloads[_l]), _header.levels[_l].bytes);
+                _written = _header.levels[_l].offset + _header.levels[_l].bytes;
+            }
+            return _file.good();
+        }
+    };
+};
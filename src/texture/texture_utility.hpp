@@ -0,0 +1,127 @@
+#pragma once
+#ifndef _TEXTURE_UTILITY_
+#define _TEXTURE_UTILITY_
+
+#include "../lrutility.hpp"
+#include "../drawing.hpp"
+#include "image_codec.hpp"
+
+namespace lightroom
+{
+    inline Texel packTexel(const Color& _color)
+    {
+        auto _channel = [](Float _value)
+        {
+            return static_cast<uint32_t>(_value * 256 <= 0 ? 0 : (_value * 256 <= 255 ? _value * 256 : 255));
+        };
+        auto _alpha = static_cast<uint32_t>(_color[3] <= 0 ? 0 : (_color[3] >= 1 ? 255 : _color[3] * 255 + Float(0.5)));
+        return (_alpha << 24) | (_channel(_color[0]) << 16) |
+            (_channel(_color[1]) << 8) | _channel(_color[2]);
+    }
+    inline Color unpackTexel(Texel _texel)
+    {
+        return Color(((_texel >> 16) & 0xff) / Float(256),
+                     ((_texel >> 8) & 0xff) / Float(256),
+                     (_texel & 0xff) / Float(256),
+                     (_texel >> 24) / Float(255));
+    }
+
+    // Runs _body(i) for every i in [0, _count) on the shared job system, on at most _threadCount threads
+    template <typename _Body>
+    inline void parallelFor(size_t _count, unsigned _threadCount, _Body&& _body)
+    {
+        JobSystem::getDefault().parallelFor(_count, _body, 1, max(1u, _threadCount));
+    }
+    // The same, packaged for the standard-library-only decoders
+    inline ParallelFor makeParallelFor(unsigned _threadCount)
+    {
+        if (_threadCount <= 1)
+        {
+            return nullptr;
+        }
+        return [_threadCount](size_t _count, const std::function<void(size_t)>& _body)
+        {
+            parallelFor(_count, _threadCount, _body);
+        };
+    }
+
+    // Row-major image decoded into packed texels, independent of any windowing library
+    class DecodedImage : public ColorMap
+    {
+    protected:
+        std::vector<Texel> _texels;
+
+    public:
+        DecodedImage(const PxCoordinate& _size) :
+            ColorMap(_size), _texels(static_cast<size_t>(_size[0]) * _size[1]) {}
+        DecodedImage(TexelImage&& _image) :
+            ColorMap({ _image.width, _image.height }), _texels(std::move(_image.texels)) {}
+        virtual ~DecodedImage() {}
+
+        virtual Color get(size_t _index) const override
+        {
+            return unpackTexel(_texels[_index]);
+        }
+
+        inline Texel* getRow(int _y)
+        {
+            return _texels.data() + static_cast<size_t>(_y) * _size[0];
+        }
+        inline const Texel* getRow(int _y) const
+        {
+            return _texels.data() + static_cast<size_t>(_y) * _size[0];
+        }
+    };
+
+    // One mip level stored as 8x8 tiles in row-major tile order, Z-order (Morton) inside each tile,
+    // so that a bilinear footprint or a diagonal walk stays within one or two cache lines
+    struct MipLevel
+    {
+        static constexpr int TILE_SHIFT = 3;
+        static constexpr int TILE_SIZE = 1 << TILE_SHIFT;
+        static constexpr int TILE_TEXELS = TILE_SIZE * TILE_SIZE;
+
+        PxCoordinate size;
+        int tilesX;
+        std::vector<Texel> texels;
+
+        MipLevel(const PxCoordinate& size = { 0, 0 }) :
+            size(size),
+            tilesX(tileCount(size[0])),
+            texels(static_cast<size_t>(tilesX) * tileCount(size[1]) * TILE_TEXELS) {}
+
+        // Spreads the three low bits of _v to even bit positions
+        inline static constexpr uint32_t spread(uint32_t _v)
+        {
+            return (_v & 1) | ((_v & 2) << 1) | ((_v & 4) << 2);
+        }
+        inline static size_t tiledIndex(int _tilesX, int _x, int _y)
+        {
+            size_t _tile = static_cast<size_t>(_y >> TILE_SHIFT) * _tilesX + (_x >> TILE_SHIFT);
+            return (_tile << (2 * TILE_SHIFT)) |
+                spread(_x & (TILE_SIZE - 1)) | (spread(_y & (TILE_SIZE - 1)) << 1);
+        }
+        inline static int tileCount(int _extent)
+        {
+            return (_extent + TILE_SIZE - 1) >> TILE_SHIFT;
+        }
+        inline size_t texelIndex(int _x, int _y) const
+        {
+            return tiledIndex(tilesX, _x, _y);
+        }
+        inline const Texel* tiledTexels() const
+        {
+            return texels.data();
+        }
+        inline Texel fetch(int _x, int _y) const
+        {
+            return texels[texelIndex(_x, _y)];
+        }
+        inline void store(int _x, int _y, Texel _texel)
+        {
+            texels[texelIndex(_x, _y)] = _texel;
+        }
+    };
+};
+
+#endif // !_TEXTURE_UTILITY_
@@ -0,0 +1,175 @@
+// Offline texture converter
+//
+//   texconv bc1 <image> <output.lrbc>     BC1 blocks (opaque, 0.5 byte per texel)
+//   texconv bc3 <image> <output.lrbc>     BC3 blocks (with alpha, 1 byte per texel)
+//   texconv lrtex <image> <output.lrtex> [argb|bc1|bc3]
+//                                         memory-mappable container, tiled ARGB by default
+//   texconv atlas <output> <image>...     packs the images into <output>0.lrtex, <output>1.lrtex...
+//                                         and writes their UV scale/offset to <output>.atlas
+//
+// Every other mode builds the full mip chain from the source image. PNG and baseline JPEG are
+// decoded natively; anything else goes through EasyX.
+
+#include <iostream>
+#include <cstring>
+#include "../lightroom.hpp"
+using namespace lightroom;
+
+namespace
+{
+    int usage()
+    {
+        std::cerr << "usage: texconv bc1|bc3 <image> <output>" << std::endl
+            << "       texconv lrtex <image> <output> [argb|bc1|bc3]" << std::endl
+            << "       texconv atlas <output> <image>..." << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<MipmapMap> loadMips(const std::filesystem::path& _input)
+    {
+        if (auto _decoded = ImageLoader().load(_input))
+        {
+            return std::make_unique<MipmapMap>(*_decoded);
+        }
+        ImageMap _image(_input.wstring().c_str());
+        if (_image.getWidth() == 0 || _image.getHeight() == 0)
+        {
+            return nullptr;
+        }
+        return std::make_unique<MipmapMap>(_image);
+    }
+
+    int atlas(const std::filesystem::path& _output, const std::vector<std::filesystem::path>& _inputs)
+    {
+        TextureAtlas _atlas;
+        auto _images = ImageLoader().loadAll(_inputs);
+        for (size_t _i = 0; _i < _inputs.size(); _i++)
+        {
+            if (_images[_i])
+            {
+                _atlas.add(std::move(_images[_i]));
+                continue;
+            }
+            ImageMap _image(_inputs[_i].wstring().c_str());
+            if (_image.getWidth() == 0 || _image.getHeight() == 0)
+            {
+                std::cerr << "cannot load " << _inputs[_i].string() << std::endl;
+                return 1;
+            }
+            _atlas.add(_image);
+        }
+        if (!_atlas.build())
+        {
+            std::cerr << "an image does not fit an atlas page" << std::endl;
+            return 1;
+        }
+
+        auto _manifest = std::filesystem::path(_output).concat(".atlas");
+        for (size_t _p = 0; _p < _atlas.getPageCount(); _p++)
+        {
+            auto _page = std::filesystem::path(_output).concat(std::to_string(_p) + ".lrtex");
+            if (!TextureFile::write(_page, _atlas.getPage(_p)))
+            {
+                std::cerr << "cannot write " << _page.string() << std::endl;
+                return 1;
+            }
+            std::cout << _page.string() << ": " << _atlas.getPage(_p).getWidth() << "x"
+                << _atlas.getPage(_p).getHeight() << std::endl;
+        }
+        if (!_atlas.saveManifest(_manifest))
+        {
+            std::cerr << "cannot write " << _manifest.string() << std::endl;
+            return 1;
+        }
+        std::cout << _manifest.string() << ": " << _atlas.getEntryCount() << " images on "
+            << _atlas.getPageCount() << " pages" << std::endl;
+        return 0;
+    }
+
+    int pack(const char* _format, const std::filesystem::path& _input, const std::filesystem::path& _output)
+    {
+        auto _loaded = loadMips(_input);
+        if (!_loaded)
+        {
+            std::cerr << "cannot load " << _input.string() << std::endl;
+            return 1;
+        }
+        auto& _mips = *_loaded;
+        bool _written;
+        if (!strcmp(_format, "argb"))
+        {
+            _written = TextureFile::write(_output, _mips);
+        }
+        else if (!strcmp(_format, "bc1") || !strcmp(_format, "bc3"))
+        {
+            _written = TextureFile::write(_output,
+                BlockCompressedMap(_mips, !strcmp(_format, "bc1") ? BlockFormat::BC1 : BlockFormat::BC3));
+        }
+        else
+        {
+            return usage();
+        }
+        if (!_written || !MappedTexture::open(_output))
+        {
+            std::cerr << "cannot write " << _output.string() << std::endl;
+            return 1;
+        }
+        std::cout << _output.string() << ": " << _mips.getWidth() << "x" << _mips.getHeight()
+            << ", " << _mips.getLevelCount() << " levels, " << std::filesystem::file_size(_output)
+            << " bytes" << std::endl;
+        return 0;
+    }
+
+    int compress(BlockFormat _format, const std::filesystem::path& _input, const std::filesystem::path& _output)
+    {
+        auto _loaded = loadMips(_input);
+        if (!_loaded)
+        {
+            std::cerr << "cannot load " << _input.string() << std::endl;
+            return 1;
+        }
+        auto& _mips = *_loaded;
+        BlockCompressedMap _compressed(_mips, _format);
+        if (!_compressed.save(_output))
+        {
+            std::cerr << "cannot write " << _output.string() << std::endl;
+            return 1;
+        }
+
+        size_t _raw = 0;
+        for (size_t _l = 0; _l < _mips.getLevelCount(); _l++)
+        {
+            auto& _size = _mips.getLevel(_l).size;
+            _raw += static_cast<size_t>(_size[0]) * _size[1] * sizeof(Texel);
+        }
+        std::cout << _output.string() << ": " << _mips.getWidth() << "x" << _mips.getHeight()
+            << ", " << _mips.getLevelCount() << " levels, " << _compressed.getByteSize() << " bytes ("
+            << _raw / _compressed.getByteSize() << "x smaller)" << std::endl;
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        return usage();
+    }
+    if (!strcmp(argv[1], "bc1"))
+    {
+        return compress(BlockFormat::BC1, argv[2], argv[3]);
+    }
+    if (!strcmp(argv[1], "bc3"))
+    {
+        return compress(BlockFormat::BC3, argv[2], argv[3]);
+    }
+    if (!strcmp(argv[1], "lrtex"))
+    {
+        return pack(argc > 4 ? argv[4] : "argb", argv[2], argv[3]);
+    }
+    if (!strcmp(argv[1], "atlas"))
+    {
+        return atlas(argv[2], std::vector<std::filesystem::path>(argv + 3, argv + argc));
+    }
+    return usage();
+}